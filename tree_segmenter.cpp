@@ -10,12 +10,32 @@
 //        (This was able to remove: portions of facades(Example: Compare WRLs in generated_wrl/med_cylinder/enclose/3_aj/)
 //        (						    current poles, vehicles(Example: Compare WRLs in generated_wrl/med_cylinder/enclose/3_ak/))
 
-// Usage: g++ -o code final_tree_segmenter_latest_v2.cpp
-// Usage: ./code environment_name number_of_3Dpoints_in_the_current_environment
+// Command line tool on top of the segmentation library (treeseg.h), which reads the map from a wrl file & writes its outputs into wrl files.
+// Usage: make (or: g++ -O2 -std=c++17 -pthread -o code tree_segmenter.cpp treeseg.cpp)
+// Usage: ./code environment_name number_of_3Dpoints_in_the_current_environment [--threads N] [--seed S] [--estimator exact|sequential] [--median-tol T] [--circle-fit median|kasa|pratt|taubin] [--ransac N] [--xy-eps E] [--growth-limit N] [--cluster-tiles T] [--voxel V] [--ground-cell C] [--ground-band B] [--shape-filters] [--cluster] [--trace off|final|steps] [--metrics file.json]
+// Usage: ./code --batch manifest_file [--threads N] [--seed S] [--estimator exact|sequential] [--median-tol T] [--circle-fit median|kasa|pratt|taubin] [--ransac N] [--xy-eps E] [--growth-limit N] [--cluster-tiles T] [--voxel V] [--ground-cell C] [--ground-band B] [--shape-filters] [--metrics file.json]
+// Usage: ./code --stream environment_name [wrl_file] [--tile-size T] [--halo H] [--threads N] [--seed S] [--estimator exact|sequential] [--median-tol T] [--circle-fit median|kasa|pratt|taubin] [--ransac N] [--xy-eps E] [--metrics file.json]
+// Usage: ./code --trace-to-wrl environment_name [trace_file]
 // Example Usage: ./code 2_ac 100000
+// 		--threads N: number of threads used to find median cylinders of the clusters (default: all cores). With --batch, number of threads running all maps.
+// 		--seed S: seed (0 to 4294967295) for the random combinations of points, to get reproducible output (output is then the same for any number of threads; default: different combinations in every run)
+// 		--estimator exact|sequential: `sequential` stops drawing random combinations once the median cylinder is known within `--median-tol` metres (default: exact)
+// 		--circle-fit median|kasa|pratt|taubin: curvature engine of the median cylinder: median of circles through random combinations, or an algebraic least-squares circle fit in linear time (default: median)
+// 		--ransac N: (algebraic fits) refit the circle to the inliers (within `circle_fit_ransac_tolerance`) of the best of N circles through random combinations (default: 0, no RANSAC)
+// 		--xy-eps E: points of a cluster whose XY-projections coincide on a grid of E metres are used only once while finding the median cylinder (default: 0.005, 0 for exact equality)
+// 		--growth-limit N: stop growing (& reject) a cluster as soon as it has more than N points after a step of growth, with the rest of its connected component (default: 0, no limit)
+// 		--cluster-tiles T: grow clusters concurrently in tiles of T x T metres (in XY), merged across the borders of tiles (default: 0, sequential growth over the whole map)
+// 		--voxel V, --ground-cell C, --ground-band B: preprocessing of the map before clustering (see Segmenter::form_clusters_preprocessed): points within B metres (default: 0.3) of the lowest point of their C x C metres XY-cell are removed as ground, & clusters are formed on the centroids of the points in each V x V x V metres voxel, then get back the points of their voxels (default: 0 & 0, no preprocessing)
+// 		--shape-filters: discard clusters whose shape can't be a tree (elongated, planar, linear or flat) before their median cylinders are found, with thresholds tuned on the 17 maps (see use_shape_prefilters; default: off)
+// 		--cluster: run the 1st part of algo on the map (& write the clusters into the cluster cache), instead of reading the clusters of an earlier run (see OUTPUTS)
+// 		--trace off|final|steps: what is recorded into the clustering trace `generated_wrl/2_ac/trace.bin` (default: final). `--trace-to-wrl` turns the trace into wrl files of the clusters (of every step, with `steps`).
+// 		--batch manifest_file: run every map listed in manifest_file (a line per map: environment_name number_of_3Dpoints [wrl_file]) on one pool of threads (see run_batch)
+// 		--stream environment_name [wrl_file]: run a map too large for memory tile by tile, with bounded memory (see run_stream). --tile-size T: tiles of T x T metres (default: 50), --halo H: margin (in metres) of points around each tile (default: proximity_threshold + 2*tree_radius_thresh)
+// 		--metrics file.json: write the time (in ns) taken by each stage (parse, cluster growth, ground removal, size filter, median radius, enclosure filter, output) & counters (of distances computed, points erased, triples sampled, clusters rejected by each stage of filtering, ...) into file.json
 // OUTPUTS:
-// Output of 1st part of algo (generated only if do_clustering == 1):
-// 		The wrl files generated after 1st part of algo are generated in `generated_wrl/2_ac` directory. I've manually moved the generated wrl files into `generated_wrl/2_ac/z_range_0.2_0.35_proxi_0.7` after code execution. Could have written code for that. Will do that as final touch-ups.
+// Output of 1st part of algo (generated only if do_clustering == 1, i.e. with --cluster, or with --batch):
+// 		The wrl files generated after 1st part of algo are generated in `generated_wrl/2_ac` directory (by `./code --trace-to-wrl 2_ac`, from the clustering trace). I've manually moved the generated wrl files into `generated_wrl/2_ac/z_range_0.2_0.35_proxi_0.7` after code execution. Could have written code for that. Will do that as final touch-ups.
+// 		All the final clusters are also saved into a single binary cache `generated_wrl/2_ac/clusters.bin`. When only the 2nd part of algo is run (do_clustering == 0), clusters are read from this cache (if it exists) instead of the wrl files.
 // Output of 2nd part of algo:
 // 		Output of 2-(a) along with median cylinders of the obtained clusters is present in "generated_wrl/med_cylinder/2_ac/median_cylinder.wrl"
 // 		Output of 2-(b) along with median cylinders of the obtained clusters is present in "generated_wrl/med_cylinder/2_ac/median_cylinder_final.wrl"
@@ -31,321 +51,138 @@
 #include <fstream>
 #include <dirent.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <charconv>
+#include "treeseg.h"
 
 using namespace std;
 
 // ******************************************************************************************************************
 // If clusters formed by grouping 3D points(output of 1st part of algo) is available, don't form clusters again. Only filter the clusters(2nd part of algo)
-int do_clustering = 0;
+int do_clustering = 0; // (set to 1 by --cluster)
 // ******************************************************************************************************************
 
-vector<vector<float>> cylinder;
-vector<float> final_med_cylinder_x;
-vector<float> final_med_cylinder_y;
-vector<float> final_med_cylinder_r;
-vector<string> viz_coordinate;
-vector<string> viz_color;
-vector<string> viz_color_final;
-vector<string> viz_coordinate_final;
 ofstream log_write;
 string clusters_path;
+string cluster_cache_path; // binary file containing all the clusters formed in 1st part of algo
+const char cluster_cache_magic[4] = {'T', 'S', 'C', 'C'};
+const uint32_t cluster_cache_version = 1;
 
-// ************************************ Various thresholds used *****************************************************
-// Should tune these values & see if better results can be obtained
-int combinations_threshold = 1000000; //hyper-parameter
-float collinearity_threshold = 0.5;  //hyper-parameter
-float proximity_threshold = 0.7;  //0.5 //hyper-parameter
-float tree_radius_thresh = 8.0;  //hyper-parameter
-float cluster_enclosing_threshold = 1.0; //hyper-parameter
-int cluster_size_low_threshold = 50; //hyper-parameter
-int cluster_size_high_threshold = 2400; //hyper-parameter
-// ******************************************************************************************************************
-
+// Hyper-parameters (thresholds) of the algorithm are in SegmenterParams (treeseg.h). The options below change some of them:
+// 	--threads: num_threads, --seed: rng_seed, --xy-eps: xy_dedup_epsilon, --estimator exact|sequential: median_estimator_sequential, --median-tol: median_tolerance, --circle-fit: circle_fit, --ransac: circle_fit_ransac_iterations, --growth-limit: growth_size_limit, --cluster-tiles: cluster_tile_size, --voxel: downsample_voxel, --ground-cell: ground_cell_size, --ground-band: ground_band, --shape-filters: max_xy_aspect, max_planarity, max_linearity & min_height_to_footprint.
+// 	--trace off|final|steps: trace_level. The trace is a single binary file `generated_wrl/<env>/trace.bin`, written by a background thread. `./code --trace-to-wrl environment_name` turns it into wrl files.
+SegmenterParams params;
+string metrics_path; // if set (with `--metrics`), stage timers & counters of the run are written into this (json) file
+const char trace_magic[4] = {'T', 'S', 'T', 'R'};
+const uint32_t trace_version = 1;
 
-void remove_ground_pts_from_cluster(vector<vector<float>>& curr_cluster, float max_z, float min_z) {
-	//if Number of pts having their z-coordinate in the bottom 20% of the range (min_z, max_z) is more than 35% of all the points in the cluster, then remove all those pts (whose z-coordinates lie in the bottom 20% of the range (min_z, max_z))
-	//we hope to remove all the ground points which are surrounding the base of the trunk(in worst case, a few points at the base of the trunk too).
-	//These 20% & 35% are tunable parameters, saved in the variables z_coord_threshold & num_points_threshold respectively.
-	
-	float z_coord_threshold = 0.2; // hyper-parameter
-	float num_points_threshold = 0.35; // hyper-parameter
-	int count = 0;
-	for (int ml=0; ml<curr_cluster.size(); ml++){
-		if ((curr_cluster[ml][2] >= min_z) && (curr_cluster[ml][2] <= (min_z+z_coord_threshold*(max_z-min_z)))) {
-			count++;
-		}
-	}
-	if (count >= (curr_cluster.size()*num_points_threshold)) {
-		for (int rl=0; rl<curr_cluster.size(); rl++){
-			if ((curr_cluster[rl][2] >= min_z) && (curr_cluster[rl][2] <= min_z+z_coord_threshold*(max_z-min_z))) {
-				curr_cluster.erase(curr_cluster.begin()+rl);
-				rl--;
-			}
-		}
-	}
-	return;
+void append_wrl_number(string& buf, double v) {
+	// Appends v formatted like to_string(v) ("%f": fixed notation, 6 decimals) to buf, without allocating a string per number.
+	char num[64];
+	char* end = to_chars(num, num+sizeof(num), v, chars_format::fixed, 6).ptr;
+	buf.append(num, end);
 }
 
-tuple<float,float> cluster_z_range(vector<vector<float>>& curr_cluster) {
-	float max_z = -1000;
-	float min_z = 1000;
-	for (int ds=0; ds< curr_cluster.size(); ds++) {
-		if (curr_cluster[ds][2]>max_z){max_z = curr_cluster[ds][2];}
-		if (curr_cluster[ds][2]<min_z){min_z = curr_cluster[ds][2];}
-	}
-	return make_tuple(max_z,min_z);
+void append_wrl_point(string& buf, double x, double y, double z) {
+	// Appends a line "      x y z,\n" of the Coordinate3 list of a wrl file to buf.
+	buf.append("      ");
+	append_wrl_number(buf, x);
+	buf.push_back(' ');
+	append_wrl_number(buf, y);
+	buf.push_back(' ');
+	append_wrl_number(buf, z);
+	buf.append(",\n");
 }
 
+// Points & colors of a wrl file, accumulated in 2 buffers (one per list of the file) & written to the file at once.
+struct WrlWriter {
+	string colors; // lines of the diffuseColor list
+	string points; // lines of the Coordinate3 list
+	long long num_points = 0;
 
-float distance_bw_points (vector<float>& point1, vector<float>& point2) {
-	return sqrt(pow((point1[0]-point2[0]),2)+pow((point1[1]-point2[1]),2)+pow((point1[2]-point2[2]),2));
-}
-
-float determinantOfMatrix(vector<vector<float>> &mat) 
-{ 
-	float ans; 
-	ans = mat[0][0] * (mat[1][1] * mat[2][2] - mat[2][1] * mat[1][2]) 
-		  - mat[0][1] * (mat[1][0] * mat[2][2] - mat[1][2] * mat[2][0]) 
-		  + mat[0][2] * (mat[1][0] * mat[2][1] - mat[1][1] * mat[2][0]); 
-	return ans; 
-} 
-  
-void findSolution(vector<vector<float>> &coeff, int flag2) 
-{ 
-
-	vector<vector<float>> d;
-	d.push_back({ coeff[0][0], coeff[0][1], coeff[0][2] });
-	d.push_back({ coeff[1][0], coeff[1][1], coeff[1][2] });
-	d.push_back({ coeff[2][0], coeff[2][1], coeff[2][2] });
-
-	vector<vector<float>> d1;
-	d1.push_back({ coeff[0][3], coeff[0][1], coeff[0][2] });
-	d1.push_back({ coeff[1][3], coeff[1][1], coeff[1][2] });
-	d1.push_back({ coeff[2][3], coeff[2][1], coeff[2][2] });
-
-	vector<vector<float>> d2;
-	d2.push_back({ coeff[0][0], coeff[0][3], coeff[0][2] });
-	d2.push_back({ coeff[1][0], coeff[1][3], coeff[1][2] });
-	d2.push_back({ coeff[2][0], coeff[2][3], coeff[2][2] });
-
-	vector<vector<float>> d3;
-	d3.push_back({ coeff[0][0], coeff[0][1], coeff[0][3] });
-	d3.push_back({ coeff[1][0], coeff[1][1], coeff[1][3] });
-	d3.push_back({ coeff[2][0], coeff[2][1], coeff[2][3] });
-  
-
-	float D = determinantOfMatrix(d); 
-	float D1 = determinantOfMatrix(d1); 
-	float D2 = determinantOfMatrix(d2); 
-	float D3 = determinantOfMatrix(d3); 
-	
-  
-	if (D != 0) { 
-		float s = D1 / D; 
-		float t = D2 / D; 
-		float u = D3 / D;
-		float temp31 = pow(s,2)+pow(t,2)-u;
-		if (temp31 < 0) {return;}
-		float r = sqrt(temp31);
-		if (!isnan(r)){
-				cylinder.push_back({s,t,r});
-		} else { // If 3 points are collinear, then the cylinder radius becomes infinite. So, append a large number as radius.
-			cylinder.push_back({s,t,100000.0});
-		}
-		
+	void clear() {
+		colors.clear();
+		points.clear();
+		num_points = 0;
 	}
-}
 
-void create_combinations(vector<vector<vector<float>>>& combinations, vector<vector<float>>& reduced_cluster1, long int num_elements) {
-	long int actual_combinations = (num_elements*(num_elements-1)*(num_elements-2));
-	// Instead of taking all possible combinations of 3 points from the cluster, take 1000000 random combinations & use them to find the median cylinder.
-	// This reduces the computational intensity & also found that, this wouldn't change the median_radius much.
-	int max_combinations;
-	if (actual_combinations > combinations_threshold) {
-		max_combinations = combinations_threshold;
-	} else {
-		max_combinations = actual_combinations;
-	}
-	// cout << actual_combinations << "|" << num_elements << "|"<< max_combinations<< endl; // change
-	// return; // change
-	std::random_device rd; // below snippet of code ensures different seed values across executions
-	std::mt19937::result_type seed1 = rd() ^ ((std::mt19937::result_type) std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() + (std::mt19937::result_type) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count());
-	std::mt19937 gen1(seed1);
-	std::mt19937::result_type seed2 = rd() ^ ((std::mt19937::result_type) std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() + (std::mt19937::result_type) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count());
-	std::mt19937 gen2(seed2);
-	std::mt19937::result_type seed3 = rd() ^ ((std::mt19937::result_type) std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() + (std::mt19937::result_type) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count());
-	std::mt19937 gen3(seed3);
-	std::uniform_int_distribution<unsigned> distrib(0, num_elements-1);
-	int index1, index2, index3;
-	vector<string> combination_indices = {};
-	vector<int> temp_vec;
-	vector<string>::iterator itr;
-
-	while (combinations.size() != max_combinations) {
-		index1 = distrib(gen1);
-		index2 = distrib(gen2);
-		while (index2 == index1) {index2 = distrib(gen2);}
-		index3 = distrib(gen3);
-		while ((index3 == index2) || (index3 == index1)) {index3 = distrib(gen3);}
-		temp_vec = {index1, index2, index3};
-		combinations.push_back({reduced_cluster1[index1], reduced_cluster1[index2], reduced_cluster1[index3]});
+	void add_points(const string& formatted_points, int count, const string& color_line) {
+		// Adds `count` points (already formatted with append_wrl_point), all of color `color_line`.
+		points.append(formatted_points);
+		for (int i=0; i<count; i++) {
+			colors.append(color_line);
+		}
+		num_points += count;
 	}
-}
 
-tuple<float,float,float> find_median_radius (vector<vector<float>>& cluster, int visualize, int curr_cluster_num, string color_line) {
-	// To get an estimate of the cluster's curvature, find the median of radii of circles passing through XY-plane projections of all possible 3-point combinations from the cluster.
-	// This is better than finding a circle which encloses the cluster, because of robustness to outliers & being influenced by most points.
-	// Finding circles which pass through all possible 3-point combinations is computationally very expensive.
-	// So, the following 2 steps are taken to reduce the compytational intensity:
-	// 1) After projecting all points onto XY-plane, consider only unique points. (But, found that, this didn't reduce the intensity to a satisfactory level. Hence, the next step.)
-	// 2) Take only 10^6 random combinations instead of all possible cobinatins.
-	// This function also generates info needed to generate wrl file to: visualize each cluster & the median cylinder corresponding to it.
-	// Finally, one wrl file for all clusters is generated.(This is done in "Visualize_med_cylinder" function.)
-	float max_z = -1000;
-	float min_z = 1000;
-	vector<vector<float>> aug_mat;//[3][4] = {
-	vector<vector<float>> combo;
-	vector<vector<float>>().swap(cylinder);
-	if (cylinder.size() != 0) {
-		return make_tuple(-121.0, -121.0, -121.0);
+	void add_point(double x, double y, double z, const string& color_line) {
+		append_wrl_point(points, x, y, z);
+		colors.append(color_line);
+		num_points++;
 	}
-	int bl, cl, pl;
 
-	cout << "***** curr_cluster_num: " << curr_cluster_num << endl;
-	log_write << "***** curr_cluster_num: "+to_string(curr_cluster_num)+"\n";
-	cout << "Un-reduced cluster size: " << cluster.size() << endl;
-	log_write << "Un-reduced cluster size: "+to_string(cluster.size())+"\n";
-
-	// Reducing cluster to have only points with unique X,Y coordinates.
-	// This reduces the computational intensity & also found that, this wouldn't change the median_radius much.
-	vector<float> reduced_cluster_x;
-	vector<float> reduced_cluster_y;
-	// vector<float> reduced_cluster_z;
-	vector<vector<float>> reduced_cluster;
-	for (pl=0; pl<cluster.size(); pl++ ){
-		if ((find(reduced_cluster_x.begin(),reduced_cluster_x.end(),cluster[pl][0]) == reduced_cluster_x.end()) || (find(reduced_cluster_y.begin(),reduced_cluster_y.end(),cluster[pl][1]) == reduced_cluster_y.end())) {
-			reduced_cluster_x.push_back(cluster[pl][0]);
-			reduced_cluster_y.push_back(cluster[pl][1]);
-			// reduced_cluster_z.push_back(cluster[pl][2]);
-			reduced_cluster.push_back({cluster[pl][0], cluster[pl][1], cluster[pl][2]});
-		}
-		if (cluster[pl][2]>max_z){max_z = cluster[pl][2];}
-		if (cluster[pl][2]<min_z){min_z = cluster[pl][2];}
-	}
-	// cout << "Reduced cluster size: " << reduced_cluster.size() << endl;
-	//############ END ###################
-	
-	vector<vector<vector<float>>> random_combinations = {};
-	create_combinations(random_combinations, reduced_cluster, reduced_cluster.size());
-	// return make_tuple(-121.0, -121.0, -121.0); // change
-	for (int ya = 0; ya < random_combinations.size(); ya++) {
-		vector<vector<float>>().swap(combo);
-		combo.push_back(random_combinations[ya][0]);
-		combo.push_back(random_combinations[ya][1]);
-		combo.push_back(random_combinations[ya][2]);
-		
-		vector<vector<float>>().swap(aug_mat);
-		// ********* Find if there is a circle passing through the projections of the 3 selected points points onto XY-plane ******
-		// ********* Use Cramer's rule to find solution of a system of linear equations.
-		aug_mat.push_back({2*combo[0][0], 2*combo[0][1], -1, pow(combo[0][0],2)+pow(combo[0][1],2)});
-		aug_mat.push_back({2*combo[1][0], 2*combo[1][1], -1, pow(combo[1][0],2)+pow(combo[1][1],2)});
-		aug_mat.push_back({2*combo[2][0], 2*combo[2][1], -1, pow(combo[2][0],2)+pow(combo[2][1],2)});
-		findSolution(aug_mat, 0);
-		// ******************************************************************************************
-	}
-
-	vector<float> avg_cylinder_x; //cumulate all obtained cylinders & find the median
-	vector<float> avg_cylinder_y;
-	vector<float> avg_cylinder_r;
-	for (int as=0; as<cylinder.size(); as++){
-		avg_cylinder_x.push_back(cylinder[as][0]);
-		avg_cylinder_y.push_back(cylinder[as][1]);
-		avg_cylinder_r.push_back(cylinder[as][2]);
-	}
-	// Since we want to find the median, it is enough to sort the vector only till middle element
-	std::nth_element(avg_cylinder_x.begin(), avg_cylinder_x.begin()+(avg_cylinder_x.size()/2)+1,avg_cylinder_x.end());
-	std::nth_element(avg_cylinder_y.begin(), avg_cylinder_y.begin()+(avg_cylinder_y.size()/2)+1,avg_cylinder_y.end());
-	std::nth_element(avg_cylinder_r.begin(), avg_cylinder_r.begin()+(avg_cylinder_r.size()/2)+1,avg_cylinder_r.end());
-	
-	float median_cylinder_x,median_cylinder_y,median_cylinder_r;
-	// cout << "Number of cylinders in the reduced_cluster: " << avg_cylinder_x.size() << endl;
-	if ((avg_cylinder_x.size()%2) == 0) {
-		median_cylinder_x = (avg_cylinder_x[(avg_cylinder_x.size()/2)-1]+avg_cylinder_x[(avg_cylinder_x.size()/2)])/2.0;
-	} else {
-		median_cylinder_x = avg_cylinder_x[(avg_cylinder_x.size()/2)];
-	}
-	
-	if ((avg_cylinder_y.size()%2) == 0) {
-		median_cylinder_y = (avg_cylinder_y[(avg_cylinder_y.size()/2)-1]+avg_cylinder_y[(avg_cylinder_y.size()/2)])/2.0;
-	} else {
-		median_cylinder_y = avg_cylinder_y[(avg_cylinder_y.size()/2)];
-	}
-	
-	if ((avg_cylinder_r.size()%2) == 0) {
-		median_cylinder_r = (avg_cylinder_r[(avg_cylinder_r.size()/2)-1]+avg_cylinder_r[(avg_cylinder_r.size()/2)])/2.0;
-	} else {
-		median_cylinder_r = avg_cylinder_r[(avg_cylinder_r.size()/2)];
+	void write(const string& path) {
+		string out;
+		out.reserve(colors.size()+points.size()+512);
+		out.append("#VRML V1.0 ascii\n");
+		out.append("\n");
+		out.append("Separator { \n");
+		out.append("  MaterialBinding { \n");
+		out.append("        value PER_VERTEX_INDEXED \n");
+		out.append("  }\n");
+		out.append("\n");
+		out.append("  Material { \n");
+		out.append("    diffuseColor [ \n");
+		out.append(colors);
+		out.append("       0 0 0 ]\n"); // adding a black point at origin, just to make coding easy(This wouldn't affect the clusters as the point is added only while visualization).
+		out.append("  } \n");
+		out.append("\n");
+		out.append("  Coordinate3 { \n");
+		out.append("    point [ \n");
+		out.append(points);
+		out.append("       0 0 0 ]\n");// adding a black point at origin, just to make coding easy(This wouldn't affect the clusters as the point is added only while visualization).
+		out.append("}\n");
+		out.append("\n");
+		out.append("  PointSet { \n");
+		out.append("    startIndex 0 \n");
+		out.append("    numPoints "+to_string(num_points+1)+"\n");
+		out.append("  } \n");
+		out.append("} \n");
+
+		ofstream myfile(path, ios::binary);
+		myfile.write(out.data(), out.size());
+		myfile.close();
 	}
+};
 
-	cout << "Radius of median cylinder: " << median_cylinder_r << endl;
-	log_write << "Radius of median cylinder: "+to_string(median_cylinder_r)+"\n";
-	// log_file << "Radius of median "<< type <<" cylinder: "+to_string(median_cylinder_r)+"\n";
-	if (visualize) {
-		string var1 = "      ";
-		string var5 = ",\n";
-		string var2, var3, var4;
-		for (int ap=0; ap<cluster.size(); ap++) { // store data about the current cluster to write to wrl file in 'Visualize_med_cylinder' function.
-			var2 = to_string(cluster[ap][0]);
-			var3 = to_string(cluster[ap][1]);
-			var4 = to_string(cluster[ap][2]);
-			viz_color.push_back(color_line);
-			viz_coordinate.push_back(var1+var2+' '+var3+' '+var4+var5);
-		}
-
-		string temp_x, temp_y;
-		int count21=0;
-		for (int aq=0; aq<360; aq+=20){ //In the wrl file,include the median cylinder corresponding to the cluster along with the cluster
-			for (float qa=min_z; qa<max_z; qa+=(max_z-min_z)/10.0 ) {
-				viz_color.push_back(color_line);
-				temp_x = to_string(median_cylinder_x+median_cylinder_r*cos(aq*3.14159/180));
-				temp_y = to_string(median_cylinder_y+median_cylinder_r*sin(aq*3.14159/180));
-				viz_coordinate.push_back(var1+temp_x+' '+temp_y+' '+to_string(qa)+var5);
-			}
+WrlWriter viz_wrl; // clusters (with their median cylinders), written into tree_<env>.wrl
+WrlWriter viz_wrl_final; // final segmentation of trees, written into tree_<env>_final.wrl
+
+
+void generate_cluster_data (PointCloud& cloud, IndexSpan cluster, const MedianCylinder& cylinder, string color_line) {
+	// Generates the info needed to generate wrl file to: visualize a cluster & the median cylinder corresponding to it.
+	// Finally, one wrl file for all clusters is generated.(This is done in "Visualize_med_cylinder" function.)
+	for (int ap=0; ap<cluster.size(); ap++) {
+		viz_wrl.add_point(cloud.x[cluster[ap]], cloud.y[cluster[ap]], cloud.z[cluster[ap]], color_line);
+	}
+	for (int aq=0; aq<360; aq+=20){ //In the wrl file,include the median cylinder corresponding to the cluster along with the cluster
+		for (float qa=cylinder.min_z; qa<cylinder.max_z; qa+=(cylinder.max_z-cylinder.min_z)/10.0 ) {
+			viz_wrl.add_point(cylinder.x+cylinder.r*cos(aq*3.14159/180), cylinder.y+cylinder.r*sin(aq*3.14159/180), qa, color_line);
 		}
 	}
-	// time(&end_med_rad);
-	// double time_taken = double(end_med_rad - start_med_rad);
-	// cout << "Time taken for cluster-"<< curr_cluster_num <<  " is : " << time_taken << endl;
-	return make_tuple(median_cylinder_x,median_cylinder_y,median_cylinder_r);
 }
 
-void generate_final_data (vector<vector<float>>& cluster, int visualize, int curr_cluster_num, string color_line) {
+void generate_final_data (PointCloud& cloud, IndexSpan cluster, int visualize, int curr_cluster_num, string color_line) {
 	// Generates the info needed to generate wrl file for the final segmentation of trees.
 	// The wrl file is actually generated in "Visualize_med_cylinder" function.
-	float max_z = -1000;
-	float min_z = 1000;
 	cout << "***** curr_cluster_num: " << curr_cluster_num << endl;
 	log_write << "***** curr_cluster_num: "+to_string(curr_cluster_num)+"\n";
-	vector<vector<float>> reduced_cluster;
-	for (int pl=0; pl<cluster.size(); pl++ ){
-		if (cluster[pl][2]>max_z){max_z = cluster[pl][2];}
-		if (cluster[pl][2]<min_z){min_z = cluster[pl][2];}
-	}
-
 	if (visualize) {
-		float median_cylinder_x, median_cylinder_y, median_cylinder_r;
-		median_cylinder_x = final_med_cylinder_x[curr_cluster_num];
-		median_cylinder_y = final_med_cylinder_y[curr_cluster_num];
-		median_cylinder_r = final_med_cylinder_r[curr_cluster_num];
-		string var1 = "      ";
-		string var5 = ",\n";
-		string var2, var3, var4;
 		for (int ap=0; ap<cluster.size(); ap++) {
-			var2 = to_string(cluster[ap][0]);
-			var3 = to_string(cluster[ap][1]);
-			var4 = to_string(cluster[ap][2]);
-			viz_color_final.push_back(color_line);
-			viz_coordinate_final.push_back(var1+var2+' '+var3+' '+var4+var5);
+			viz_wrl_final.add_point(cloud.x[cluster[ap]], cloud.y[cluster[ap]], cloud.z[cluster[ap]], color_line);
 		}
 	}
 }
@@ -353,117 +190,118 @@ void generate_final_data (vector<vector<float>>& cluster, int visualize, int cur
 void Visualize_med_cylinder (string env, string name, int flag2) {
 	//If flag2 ==0, Generate wrl to visualize clusters (with relevant radius(radius < threshold) of the corresponding median cylinder).
 	//If flag2 ==1, Generate the final wrl file containing segmented trees
-	ofstream myfile;
+	// Called once, after the points of all clusters have been added to viz_wrl / viz_wrl_final.
 	string temp_file1 = "generated_wrl/med_cylinder/enclose/";
 	string temp_file2 = "/"+name+"_"+env;
 	string temp_file3;
 	if (flag2==0){temp_file3 = ".wrl";} 
 	if (flag2==1){temp_file3 = "_final.wrl";}
-	myfile.open (temp_file1+env+temp_file2+temp_file3);
-
-	myfile << "#VRML V1.0 ascii\n";
-	myfile << "\n";
-	myfile << "Separator { \n";
-	myfile << "  MaterialBinding { \n";
-	myfile << "        value PER_VERTEX_INDEXED \n";
-	myfile << "  }\n";
-	myfile << "\n";
-	myfile << "  Material { \n";
-	myfile << "    diffuseColor [ \n";
-	
-	if (flag2==0){
-		for (int yak=0; yak<viz_color.size(); yak++ ){
-			myfile <<viz_color[yak];
-		}
-	}
-	if (flag2==1){
-		for (int yak=0; yak<viz_color_final.size(); yak++ ){
-			myfile <<viz_color_final[yak];
-		}
-	}
-
-	myfile << "       0 0 0 ]\n"; // adding a black point at origin, just to make coding easy(This wouldn't affect the clusters as the point is added only while visualization).
-	myfile << "  } \n";
-	myfile << "\n";
-	myfile << "  Coordinate3 { \n";
-	myfile << "    point [ \n";
-
-	if (flag2==0){
-		for (int yam=0; yam<viz_coordinate.size(); yam++ ){
-			myfile <<viz_coordinate[yam];
-		}
-	}
-	if (flag2==1){
-		for (int yam=0; yam<viz_coordinate_final.size(); yam++ ){
-			myfile <<viz_coordinate_final[yam];
-		}
-	}
-	
-	myfile << "       0 0 0 ]\n";// adding a black point at origin, just to make coding easy(This wouldn't affect the clusters as the point is added only while visualization).
-	myfile << "}\n";
-	myfile << "\n";
-	myfile << "  PointSet { \n";
-	myfile << "    startIndex 0 \n";
-	string var7 = "    numPoints ";
-	string var8 = "\n";
-	string num_points;
-	if (flag2==0){num_points = to_string(viz_color.size()+1);}
-	if (flag2==1){num_points = to_string(viz_color_final.size()+1);}
-	myfile << var7+num_points+var8;
-	myfile << "  } \n";
-	myfile << "} \n";
-
-	myfile.close();
+	if (flag2==0){viz_wrl.write(temp_file1+env+temp_file2+temp_file3);}
+	if (flag2==1){viz_wrl_final.write(temp_file1+env+temp_file2+temp_file3);}
 	// cout << "Generated wrl file for clusters" << endl;
 }
 
-void Visualize (vector<vector<float>>& vec_i, string name, string env) {
+void Visualize (PointCloud& cloud, IndexSpan vec_i, string name, string env) {
 	// Function to visualize the clusters formed by grouping 3D points (in 1st step of algorithm.)
-	ofstream myfile;
+	static WrlWriter writer; // reused across calls, so that its buffers are allocated only once
 	string temp_file1 = "generated_wrl/"+env+"/cluster_";
 	string temp_file2 = name;//"tree";//_oakland_part2_ak";
 	string temp_file3 = ".wrl";
-	myfile.open (temp_file1+temp_file2+temp_file3);
-
-	myfile << "#VRML V1.0 ascii\n";
-	myfile << "\n";
-	myfile << "Separator { \n";
-	myfile << "  MaterialBinding { \n";
-	myfile << "        value PER_VERTEX_INDEXED \n";
-	myfile << "  }\n";
-	myfile << "\n";
-	myfile << "  Material { \n";
-	myfile << "    diffuseColor [ \n";
-	
-	for (int yak=0; yak<vec_i.size(); yak++ ){
-		myfile << "      "+to_string(0)+' '+to_string(0)+' '+to_string(1)+",\n";
+	string color_line = "      "+to_string(0)+' '+to_string(0)+' '+to_string(1)+",\n";
+
+	writer.clear();
+	for (int yam=0; yam<vec_i.size(); yam++ ){
+		writer.add_point(cloud.x[vec_i[yam]], cloud.y[vec_i[yam]], cloud.z[vec_i[yam]], color_line);
 	}
+	writer.write(temp_file1+temp_file2+temp_file3);
+	// cout << "Generated wrl file for clusters" << endl;
+}
 
-	myfile << "       0 0 0 ]\n";// adding a point at origin, just to make coding easy(This wouldn't affect the clusters as the point is added only while visualization).
-	myfile << "  } \n";
-	myfile << "\n";
-	myfile << "  Coordinate3 { \n";
-	myfile << "    point [ \n";
+bool parse_wrl_triple(const char* p, const char* eol, float* v) {
+	// Parses a line of the form "      x y z," (like the lines of the Coordinate3/diffuseColor lists of a wrl file) into v[0..2].
+	// As with the regex used earlier, the 3rd number has to be followed by a ',' or a white space (so "0 0 0 ]" is a valid point, but "x y z" at the end of a line isn't).
+	while (p < eol && isspace((unsigned char)*p)) {p++;}
+	if ((eol-p >= 5) && (strncmp(p, "point", 5) == 0)) {p += 5;} // "point [ x y z," (all points on the line opening the list)
+	while (p < eol && isspace((unsigned char)*p)) {p++;}
+	if ((p < eol) && (*p == '[')) {p++;}
+	for (int k=0; k<3; k++) {
+		if (k > 0) { // numbers are separated by white spaces
+			if ((p >= eol) || !isspace((unsigned char)*p)) {return false;}
+			while (p < eol && isspace((unsigned char)*p)) {p++;}
+		}
+		from_chars_result res = from_chars(p, eol, v[k]);
+		if (res.ec != errc()) {return false;}
+		p = res.ptr;
+	}
+	return (p < eol) && ((*p == ',') || isspace((unsigned char)*p));
+}
 
-	
-	for (int yam=0; yam<vec_i.size(); yam++ ){
-		myfile <<"      "+to_string(vec_i[yam][0])+' '+to_string(vec_i[yam][1])+' '+to_string(vec_i[yam][2])+",\n";
+template<class F> int scan_wrl(string path, int skip_lines, int max_points, vector<float>* colors, F on_point) {
+	// Scans the points in the `Coordinate3` node of a VRML V1.0 wrl file (& optionally, the colors in its `diffuseColor` list), calling on_point(x, y, z) for each point.
+	// The file is memory-mapped & numbers are scanned with `from_chars` (no regex & no copying of lines into strings), which makes reading the maps much faster.
+	// (Pages of the file are read sequentially & can be dropped by the OS once scanned, so a file larger than memory can be scanned.)
+	// The first `skip_lines`-1 lines are skipped (number of points in the map can be passed, to skip the `diffuseColor` list of a map without scanning it).
+	// Scanning stops once `max_points` points are read (if `max_points` > 0).
+	// Returns number of points read (-1 if the file couldn't be opened).
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {return -1;}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
 	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	size_t len = st.st_size;
+	void* mapped = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {return -1;}
+	madvise(mapped, len, MADV_SEQUENTIAL);
 
-	myfile << "       0 0 0 ]\n";// adding a point at origin, just to make coding easy(This wouldn't affect the clusters as the point is added only while visualization).
-	myfile << "}\n";
-	myfile << "\n";
-	myfile << "  PointSet { \n";
-	myfile << "    startIndex 0 \n";
-	string var7 = "    numPoints ";
-	string var8 = "\n";
-	string num_points = to_string(vec_i.size()+1);
-	myfile << var7+num_points+var8; 
-	myfile << "  } \n";
-	myfile << "} \n";
+	const char* data = (const char*) mapped;
+	const char* end = data+len;
+	int line_num = 0, num_read = 0;
+	int list = 0; // list being read: 0 = none, 1 = diffuseColor, 2 = Coordinate3
+	float v[3];
+	for (const char* line = data; line < end; ) {
+		const char* eol = (const char*) memchr(line, '\n', end-line);
+		if (eol == NULL) {eol = end;}
+		line_num++;
+		if (line_num >= skip_lines) {
+			string_view x(line, eol-line);
+			if (x.find("Coordinate3") != string_view::npos) {list = 2;}
+			else if ((colors != NULL) && (x.find("diffuseColor") != string_view::npos)) {list = 1;}
+			if ((list != 0) && parse_wrl_triple(line, eol, v)) {
+				if (list == 2) {
+					on_point(v[0], v[1], v[2]);
+					num_read++;
+					if ((max_points > 0) && (num_read >= max_points)) {break;}
+				} else if (colors != NULL) { // (list is only 1 if colors != NULL)
+					colors->insert(colors->end(), v, v+3);
+				}
+			}
+			if ((list != 0) && (x.find(']') != string_view::npos)) { // end of the list
+				if (list == 2) {break;}
+				list = 0;
+			}
+		}
+		line = eol+1;
+	}
+	munmap(mapped, len);
+	return num_read;
+}
 
-	myfile.close();
-	// cout << "Generated wrl file for clusters" << endl;
+int read_wrl(string path, PointCloud& cloud, int skip_lines, int max_points, int label, vector<float>* colors = NULL) {
+	// Reads the points of a wrl file straight into `cloud` (see scan_wrl).
+	// `index` of the points read is their position in the Coordinate3 list & their `label` is `label`.
+	// Returns number of points read (-1 if the file couldn't be opened).
+	int num_read = 0;
+	return scan_wrl(path, skip_lines, max_points, colors, [&](float x, float y, float z) {
+		cloud.push_back(x, y, z, num_read, label);
+		num_read++;
+	});
 }
 
 void list_dir(const char* path, vector<string>& vec2) {//str.c_str()
@@ -481,231 +319,707 @@ void list_dir(const char* path, vector<string>& vec2) {//str.c_str()
 	closedir(dir);
 	sort(vec1.begin(), vec1.end());//, greater<string>());
 
-	vector<vector<int>> clusters_and_steps(1000, vector<int>());
-	int curr_cluster_num;//, prev_cluster_num=0;
-	string x;
+	map<int,int> last_step_of_cluster; // cluster number -> last step of its growth (no limit on number of clusters)
+	int curr_cluster_num, curr_step;
+	regex re("cluster_(\\d*)_step(\\d*)_after_gnd_removal.wrl");
+	smatch match;
 	for (int i=0; i<vec1.size(); i++) {
-		x = vec1[i];
-		
-		regex re("cluster_(\\d*)_step(\\d*)_after_gnd_removal.wrl");
-		for (sregex_iterator it = sregex_iterator(x.begin(), x.end(), re); it != sregex_iterator(); it++) {
-			smatch match;
-			match = *it;
+		if (regex_match(vec1[i], match, re)) {
 			curr_cluster_num = stoi(match.str(1));
-			clusters_and_steps[curr_cluster_num].push_back(stoi(match.str(2)));
+			curr_step = stoi(match.str(2));
+			if (last_step_of_cluster[curr_cluster_num] < curr_step) {last_step_of_cluster[curr_cluster_num] = curr_step;}
+		}
+	}
+
+	for (int i=1; last_step_of_cluster.count(i) != 0; i++) {
+		vec2.push_back(clusters_path+"cluster_"+to_string(i)+"_step"+to_string(last_step_of_cluster[i])+"_after_gnd_removal.wrl");
+	}
+}
+
+void write_cluster_cache(string path, PointCloud& cloud, vector<int>& cluster_members, vector<pair<int,int>>& cluster_bounds) {
+	// Saves the final clusters (output of 1st part of algo) into a single binary file, so that the 2nd part of algo can be re-run without reading/parsing wrl files of every cluster.
+	// Layout: header {magic "TSCC", version, number of clusters, number of points}, table of offsets (number of clusters + 1) of the clusters' 1st points & finally packed float32 x,y,z of all points (cluster after cluster).
+	ofstream myfile(path, ios::binary);
+	if (!myfile) {
+		cout << "Unable to write cluster cache " << path << endl;
+		return;
+	}
+	uint64_t num_clusters = cluster_bounds.size();
+	uint64_t num_points = 0;
+	vector<uint64_t> offsets(num_clusters+1);
+	for (int i=0; i<num_clusters; i++) {
+		offsets[i] = num_points;
+		num_points += cluster_bounds[i].second;
+	}
+	offsets[num_clusters] = num_points;
+	vector<float> xyz;
+	xyz.reserve(3*num_points);
+	for (int i=0; i<num_clusters; i++) {
+		for (int j=cluster_bounds[i].first; j<cluster_bounds[i].first+cluster_bounds[i].second; j++) {
+			int pt = cluster_members[j];
+			xyz.push_back(cloud.x[pt]);
+			xyz.push_back(cloud.y[pt]);
+			xyz.push_back(cloud.z[pt]);
+		}
+	}
+	myfile.write(cluster_cache_magic, 4);
+	myfile.write((const char*) &cluster_cache_version, sizeof(cluster_cache_version));
+	myfile.write((const char*) &num_clusters, sizeof(num_clusters));
+	myfile.write((const char*) &num_points, sizeof(num_points));
+	myfile.write((const char*) offsets.data(), offsets.size()*sizeof(uint64_t));
+	myfile.write((const char*) xyz.data(), xyz.size()*sizeof(float));
+	myfile.close();
+}
+
+int read_cluster_cache(string path, PointCloud& cloud, vector<pair<int,int>>& cluster_bounds) {
+	// Memory-maps the cluster cache written by `write_cluster_cache` & appends its points to `cloud` (`label` of each point is its cluster number, starting from 1).
+	// Returns number of clusters read (-1 if the cache doesn't exist or isn't valid).
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {return -1;}
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size < 24)) {
+		close(fd);
+		return -1;
+	}
+	size_t len = st.st_size;
+	void* mapped = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {return -1;}
+
+	const char* data = (const char*) mapped;
+	uint32_t version;
+	uint64_t num_clusters, num_points;
+	memcpy(&version, data+4, sizeof(version));
+	memcpy(&num_clusters, data+8, sizeof(num_clusters));
+	memcpy(&num_points, data+16, sizeof(num_points));
+	size_t expected_len = 24+(num_clusters+1)*sizeof(uint64_t)+3*num_points*sizeof(float);
+	if ((memcmp(data, cluster_cache_magic, 4) != 0) || (version != cluster_cache_version) || (num_clusters > len) || (num_points > len) || (len != expected_len)) {
+		cout << "Invalid cluster cache " << path << endl;
+		munmap(mapped, len);
+		return -1;
+	}
+	const uint64_t* offsets = (const uint64_t*) (data+24);
+	const float* xyz = (const float*) (data+24+(num_clusters+1)*sizeof(uint64_t));
+	bool valid_offsets = (offsets[0] == 0) && (offsets[num_clusters] == num_points); // (& offsets never decrease, so every cluster lies within the points)
+	for (uint64_t i=0; valid_offsets && (i<num_clusters); i++) {valid_offsets = (offsets[i] <= offsets[i+1]);}
+	if (!valid_offsets) {
+		cout << "Invalid cluster cache " << path << endl;
+		munmap(mapped, len);
+		return -1;
+	}
+	cloud.reserve(cloud.size()+num_points);
+	for (int i=0; i<num_clusters; i++) {
+		int cluster_start = cloud.size();
+		for (uint64_t j=offsets[i]; j<offsets[i+1]; j++) {
+			cloud.push_back(xyz[3*j], xyz[3*j+1], xyz[3*j+2], j-offsets[i], i+1);
+		}
+		cluster_bounds.push_back({cluster_start, cloud.size()-cluster_start});
+	}
+	munmap(mapped, len);
+	return num_clusters;
+}
+
+struct TracePoint {
+	int32_t index;
+	float x, y, z;
+};
+
+// Append-only writer of the clustering trace. Records are serialized into `pending` (under a lock) by the clustering thread &
+// written to the file by a background thread, which swaps `pending` with its own buffer, so that clustering never waits for the disk.
+struct TraceWriter : ClusterTraceSink {
+	ofstream file;
+	string pending, writing;
+	mutex lock;
+	condition_variable wake;
+	bool done = false;
+	thread worker;
+
+	bool open(string path) {
+		file.open(path, ios::binary);
+		if (!file) {return false;}
+		file.write(trace_magic, 4);
+		file.write((const char*) &trace_version, sizeof(trace_version));
+		done = false;
+		worker = thread([this]() {
+			unique_lock<mutex> guard(lock);
+			while (true) {
+				wake.wait(guard, [this]() {return done || !pending.empty();});
+				if (pending.empty() && done) {break;}
+				swap(pending, writing);
+				guard.unlock();
+				file.write(writing.data(), writing.size());
+				writing.clear();
+				guard.lock();
+			}
+		});
+		return true;
+	}
+
+	bool is_open() {
+		return worker.joinable();
+	}
+
+	void add(TraceRecordHeader header, PointCloud& cloud, const int* added, const int* removed) override {
+		// Adds a record whose added points are added[0..header.num_added) & removed points are removed[0..header.num_removed).
+		if (!is_open()) {return;}
+		lock_guard<mutex> guard(lock);
+		pending.append((const char*) &header, sizeof(header));
+		for (int i=0; i<header.num_added; i++) {
+			TracePoint pt = {added[i], cloud.x[added[i]], cloud.y[added[i]], cloud.z[added[i]]};
+			pending.append((const char*) &pt, sizeof(pt));
+		}
+		if (header.num_removed > 0) {pending.append((const char*) removed, header.num_removed*sizeof(int32_t));} // (`removed` may be NULL if there's none)
+		wake.notify_one();
+	}
+
+	void close() {
+		if (!is_open()) {return;}
+		{
+			lock_guard<mutex> guard(lock);
+			done = true;
 		}
+		wake.notify_one();
+		worker.join();
+		file.close();
 	}
+};
 
-	for (int i=1; i<clusters_and_steps.size(); i++) {
-		if (clusters_and_steps[i].size() == 0) {
+TraceWriter trace;
+
+void trace_to_wrl(string env, string path) {
+	// Replays the clustering trace at `path` & writes the snapshot of each record as a wrl file (with the same names as `Visualize` used during clustering):
+	// generated_wrl/<env>/cluster_<cluster>_step<step>_before_gnd_removal.wrl / _after_gnd_removal.wrl.
+	// A final cluster is written as the after-ground-removal file of its last step, which is the file read when only the 2nd part of algo is run.
+	ifstream myfile(path, ios::binary);
+	char magic[4];
+	uint32_t version;
+	if (!myfile.read(magic, 4) || !myfile.read((char*) &version, sizeof(version)) || (memcmp(magic, trace_magic, 4) != 0) || (version != trace_version)) {
+		cout << "Unable to read trace " << path << endl;
+		exit(1);
+	}
+	PointCloud points; // points of the current growth attempt
+	unordered_map<int,int> slot_of_point; // index into the map -> index into `points`
+	vector<int> members; // points of the cluster (indices into `points`), in order
+	vector<TracePoint> added;
+	vector<int32_t> removed;
+	unordered_set<int> removed_slots;
+	TraceRecordHeader header;
+	int attempt = -1, num_records = 0;
+	while (myfile.read((char*) &header, sizeof(header))) {
+		added.resize(header.num_added);
+		removed.resize(header.num_removed);
+		myfile.read((char*) added.data(), added.size()*sizeof(TracePoint));
+		myfile.read((char*) removed.data(), removed.size()*sizeof(int32_t));
+		if (!myfile) {
+			cout << "Truncated trace " << path << endl;
 			break;
 		}
-		sort(clusters_and_steps[i].begin(), clusters_and_steps[i].end());
-		vec2.push_back(clusters_path+"cluster_"+to_string(i)+"_step"+to_string(clusters_and_steps[i][clusters_and_steps[i].size()-1])+"_after_gnd_removal.wrl");
+		if (header.attempt != attempt) {
+			attempt = header.attempt;
+			points = PointCloud();
+			slot_of_point.clear();
+			members.clear();
+		}
+		for (int i=0; i<added.size(); i++) {
+			slot_of_point[added[i].index] = points.size();
+			members.push_back(points.size());
+			points.push_back(added[i].x, added[i].y, added[i].z, added[i].index);
+		}
+		if (!removed.empty()) {
+			removed_slots.clear();
+			for (int i=0; i<removed.size(); i++) {
+				removed_slots.insert(slot_of_point[removed[i]]);
+			}
+			members.erase(remove_if(members.begin(), members.end(), [&](int m) {return removed_slots.count(m) != 0;}), members.end());
+		}
+		string phase = (header.phase == 0) ? "_before_gnd_removal" : "_after_gnd_removal";
+		Visualize(points, IndexSpan(members), to_string(header.cluster)+"_step"+to_string(header.step)+phase, env);
+		num_records++;
+	}
+	cout << "Wrote " << num_records << " wrl files from " << path << endl;
+}
+
+// ************************************ Batch of maps ************************************
+// `./code --batch manifest.txt [options]` runs both parts of algo on every map listed in the manifest, one line per map:
+// 		environment_name number_of_3Dpoints_in_the_current_environment [wrl_file]    (default wrl_file: ../wrl/oakland_part<environment_name>.wrl)
+// Maps (reading, clustering, filtering & writing) & the median cylinders of their clusters are all tasks of one work-stealing pool (TaskPool),
+// so the threads which finish a small map (or a small cluster) steal the clusters of the maps still running & all cores stay busy until the batch is done.
+// For each map, the clusters are saved into generated_wrl/<env>/clusters.bin & the final output into generated_wrl/med_cylinder/enclose/<env>/tree_<env>_final.wrl.
+// A line is printed as each map completes & a report of all maps at the end. Maps are run without trace & without their per-cluster logs.
+struct BatchMap {
+	string environment;
+	int num_points;
+	string wrl_path;
+	string error; // empty if the map was run
+	int points = 0, clusters = 0, candidates = 0, trees = 0;
+	double seconds = 0; // time taken by the map
+	double finished_at = 0; // time since the start of the batch
+	Metrics metrics;
+};
+
+void make_dirs(string path) {
+	// Creates the directory `path` & its parents (if they don't exist).
+	for (size_t pos = path.find('/'); ; pos = path.find('/', pos+1)) {
+		mkdir(path.substr(0, pos).c_str(), 0755);
+		if (pos == string::npos) {break;}
 	}
 }
 
-float distance_bw_points_projection (vector<float>& point1, vector<float>& point2) {
-	return sqrt(pow((point1[0]-point2[0]),2)+pow((point1[1]-point2[1]),2));
+void run_batch_map(BatchMap& m, TaskPool& pool) {
+	Segmenter segmenter(params);
+	segmenter.params.verbose = 0;
+	segmenter.params.trace_level = trace_off;
+	segmenter.pool = &pool;
+	segmenter.metrics.enabled = true;
+	PointCloud coordinate;
+	{
+		StageTimer timer(segmenter.metrics, Metrics::stage_parse);
+		if (read_wrl(m.wrl_path, coordinate, m.num_points, 0, -1) < 0) {
+			m.error = "Unable to open file "+m.wrl_path;
+			return;
+		}
+	}
+	m.points = coordinate.size();
+	ClusterSet clusters;
+	segmenter.form_clusters(coordinate, clusters);
+	FilterResult result;
+	segmenter.filter_clusters(coordinate, clusters, result);
+	{
+		StageTimer timer(segmenter.metrics, Metrics::stage_output);
+		make_dirs("generated_wrl/"+m.environment);
+		write_cluster_cache("generated_wrl/"+m.environment+"/clusters.bin", coordinate, clusters.members, clusters.bounds);
+		const string colors[6] = {"      0 0 1,\n", "      0 1 0,\n", "      1 0 0,\n", "      1 1 0,\n", "      0 1 1,\n", "      1 0 1,\n"}; // (same colors as the output of a single map)
+		WrlWriter final_wrl;
+		for (int t=0; t<result.trees.size(); t++) {
+			IndexSpan cluster = clusters[result.candidates[result.trees[t]]];
+			for (int i=0; i<cluster.size(); i++) {
+				final_wrl.add_point(coordinate.x[cluster[i]], coordinate.y[cluster[i]], coordinate.z[cluster[i]], colors[t%6]);
+			}
+		}
+		if (!result.trees.empty()) {
+			string dir = "generated_wrl/med_cylinder/enclose/"+m.environment;
+			make_dirs(dir);
+			final_wrl.write(dir+"/tree_"+m.environment+"_final.wrl");
+		}
+	}
+	m.clusters = clusters.size();
+	m.candidates = result.candidates.size();
+	m.trees = result.trees.size();
+	m.metrics = segmenter.metrics;
+}
+
+void run_batch(string manifest_path) {
+	vector<BatchMap> maps;
+	ifstream manifest(manifest_path);
+	if (!manifest) {
+		cout << "Unable to open manifest " << manifest_path << endl;
+		exit(1);
+	}
+	string line;
+	while (getline(manifest, line)) {
+		stringstream fields(line);
+		BatchMap m;
+		if (!(fields >> m.environment) || (m.environment[0] == '#')) {continue;} // blank line or comment
+		if (!(fields >> m.num_points)) {
+			cout << "Bad line in manifest: " << line << endl;
+			exit(1);
+		}
+		if (!(fields >> m.wrl_path)) {m.wrl_path = "../wrl/oakland_part"+m.environment+".wrl";}
+		maps.push_back(m);
+	}
+
+	TaskPool pool(params.num_threads);
+	cout << "Running " << maps.size() << " maps on " << pool.size() << " threads" << endl;
+	auto start = chrono::steady_clock::now();
+	mutex report_lock;
+	int done = 0;
+	TaskGroup group;
+	for (int i=0; i<maps.size(); i++) {
+		pool.submit([&, i]() {
+			BatchMap& m = maps[i];
+			auto map_start = chrono::steady_clock::now();
+			run_batch_map(m, pool);
+			auto now = chrono::steady_clock::now();
+			m.seconds = chrono::duration<double>(now-map_start).count();
+			m.finished_at = chrono::duration<double>(now-start).count();
+			lock_guard<mutex> guard(report_lock);
+			done++;
+			cout << "[" << done << "/" << maps.size() << "] " << m.environment << " done at " << fixed << setprecision(2) << m.finished_at << " s: ";
+			if (m.error.empty()) {
+				cout << m.points << " points, " << m.clusters << " clusters, " << m.candidates << " of relevant sizes & shapes, " << m.trees << " trees (" << m.seconds << " s)" << endl;
+			} else {
+				cout << m.error << endl;
+			}
+		}, &group);
+	}
+	pool.wait(group);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+
+	// report of all maps (in the order of the manifest), with the time of each stage
+	const double ns = 1e9;
+	cout << endl << left << setw(12) << "map" << right << setw(10) << "points" << setw(10) << "clusters" << setw(8) << "trees" << setw(10) << "read(s)" << setw(12) << "cluster(s)" << setw(11) << "median(s)" << setw(11) << "filter(s)" << setw(11) << "output(s)" << setw(10) << "total(s)" << setw(10) << "done at" << endl;
+	int failed = 0;
+	for (int i=0; i<maps.size(); i++) {
+		BatchMap& m = maps[i];
+		cout << left << setw(12) << m.environment << right;
+		if (!m.error.empty()) {
+			cout << "  " << m.error << endl;
+			failed++;
+			continue;
+		}
+		long long* t = m.metrics.stage_ns;
+		cout << setw(10) << m.points << setw(10) << m.clusters << setw(8) << m.trees << setprecision(2)
+		     << setw(10) << t[Metrics::stage_parse]/ns << setw(12) << (t[Metrics::stage_preprocess]+t[Metrics::stage_cluster_growth])/ns << setw(11) << t[Metrics::stage_median_radius]/ns
+		     << setw(11) << (t[Metrics::stage_size_filter]+t[Metrics::stage_enclosure_filter])/ns << setw(11) << t[Metrics::stage_output]/ns
+		     << setw(10) << m.seconds << setw(10) << m.finished_at << endl;
+	}
+	cout << "Batch of " << maps.size() << " maps (" << failed << " failed) took " << seconds << " s on " << pool.size() << " threads (idle " << setprecision(1) << 100*pool.idle_fraction() << "% of the time)" << endl;
+	if (!metrics_path.empty()) { // stage timers & counters of each map, as json
+		ofstream metrics_file(metrics_path);
+		metrics_file << "{\n";
+		for (int i=0; i<maps.size(); i++) {
+			metrics_file << "\"" << maps[i].environment << "\": " << maps[i].metrics.to_json() << ((i+1 < maps.size()) ? ",\n" : "");
+		}
+		metrics_file << "}\n";
+	}
+}
+
+// ************************************ Streaming of a large map ************************************
+// `./code --stream environment_name [wrl_file] [options]` runs both parts of algo on a map which doesn't fit into memory, tile by tile:
+// 1) The wrl file is scanned once & each point is appended to the spill file (generated_wrl/<env>/tiles/<tx>_<ty>.bin) of every tile (square of
+// 		`--tile-size` metres in XY) whose extended square (the tile & a halo of `--halo` metres around it) contains the point. Spilled points
+// 		are buffered in memory up to `spill_buffer_bytes` & then appended to their files.
+// 2) Tiles are segmented one after another (in the order of their rows & columns), each with only the points of its extended square, in the
+// 		order of the map. A tree near the border of tiles is found in the halos of neighboring tiles as well, & its clusters may differ from tile
+// 		to tile (e.g. a halo too narrow cuts it). So it's kept by the tile containing its centroid & trees are deduplicated point by point (see
+// 		TileTreeMerger): each point is written once. The halo should cover a whole tree, so that a tree isn't cut by the edge of the halo: it's
+// 		at least `proximity_threshold` (default: proximity_threshold + 2*tree_radius_thresh).
+// 3) "index tree_number" of each point of the trees of a tile (which no earlier tile wrote) is appended to generated_wrl/<env>/labels.txt
+// 		(index of the point in the map), as soon as the tile is done. The points & their colors (a color per tree) are appended to temporary
+// 		files, which make up the final output (generated_wrl/med_cylinder/enclose/<env>/tree_<env>_final.wrl) once the last tile is done.
+// Memory used is bounded by the points of one extended tile (& the spill buffers), instead of the whole map. A line is printed as each tile completes.
+// Median cylinders are found on `--threads` threads. Clusters are numbered within their tile (which seeds their random combinations).
+float stream_tile_size = 50; // (--tile-size)
+float stream_halo = 0; // (--halo) 0: proximity_threshold + 2*tree_radius_thresh
+const size_t spill_buffer_bytes = 64 << 20;
+
+struct SpillPoint { // a point, as appended to the spill file of a tile
+	float x, y, z;
+	int index; // index of the point in the map
+};
+
+// Buffered appends of points to the spill files of tiles (files are only opened while a buffer is flushed, so any number of tiles can be spilled).
+struct TileSpill {
+	string dir;
+	map<pair<int,int>, vector<SpillPoint>> buffers; // (tx, ty) -> points not yet appended to the file of the tile
+	set<pair<int,int>> tiles; // all tiles spilled to
+	size_t buffered = 0;
+
+	string path(pair<int,int> tile) {
+		return dir+"/"+to_string(tile.first)+"_"+to_string(tile.second)+".bin";
+	}
+
+	void add(pair<int,int> tile, const SpillPoint& p) {
+		if (tiles.insert(tile).second) {remove(path(tile).c_str());} // (left from an earlier run)
+		buffers[tile].push_back(p);
+		buffered += sizeof(SpillPoint);
+		if (buffered >= spill_buffer_bytes) {flush();}
+	}
+
+	void flush() {
+		for (auto& b : buffers) {
+			ofstream out(path(b.first), ios::binary | ios::app);
+			out.write((const char*) b.second.data(), b.second.size()*sizeof(SpillPoint));
+			if (!out) {
+				cout << "Unable to write " << path(b.first) << endl;
+				exit(1);
+			}
+		}
+		buffers.clear();
+		buffered = 0;
+	}
+};
+
+void run_stream(string environment, string wrl_path) {
+	float tile_size = stream_tile_size;
+	float halo = (stream_halo > 0) ? max(stream_halo, params.proximity_threshold) : params.proximity_threshold+2*params.tree_radius_thresh;
+	Segmenter segmenter(params);
+	segmenter.params.verbose = 0;
+	segmenter.params.trace_level = trace_off;
+	segmenter.metrics.enabled = true;
+	TaskPool pool(params.num_threads);
+	segmenter.pool = &pool;
+	auto start = chrono::steady_clock::now();
+
+	// 1) spill the points into the tiles whose extended squares contain them
+	TileSpill spill;
+	spill.dir = "generated_wrl/"+environment+"/tiles";
+	make_dirs(spill.dir);
+	int num_points;
+	{
+		StageTimer timer(segmenter.metrics, Metrics::stage_parse);
+		int index = 0;
+		num_points = scan_wrl(wrl_path, 0, 0, NULL, [&](float x, float y, float z) {
+			int tx0 = floor((x-halo)/tile_size), tx1 = floor((x+halo)/tile_size);
+			int ty0 = floor((y-halo)/tile_size), ty1 = floor((y+halo)/tile_size);
+			for (int ty=ty0; ty<=ty1; ty++) {
+				for (int tx=tx0; tx<=tx1; tx++) {spill.add({tx, ty}, {x, y, z, index});}
+			}
+			index++;
+		});
+		spill.flush();
+	}
+	if (num_points < 0) {
+		cout << "Unable to open file " << wrl_path << endl;
+		exit(1);
+	}
+	vector<pair<int,int>> tiles(spill.tiles.begin(), spill.tiles.end());
+	sort(tiles.begin(), tiles.end(), [](pair<int,int> a, pair<int,int> b) {return make_pair(a.second, a.first) < make_pair(b.second, b.first);}); // rows, then columns
+	cout << "Streaming " << num_points << " points of " << wrl_path << " in " << tiles.size() << " tiles of " << tile_size << " m (halo of " << halo << " m)" << endl;
+
+	// 2) & 3) segment each tile & stream the trees it keeps
+	string out_dir = "generated_wrl/med_cylinder/enclose/"+environment;
+	make_dirs(out_dir);
+	ofstream labels("generated_wrl/"+environment+"/labels.txt");
+	// (the colors of a wrl file are listed before its points: the points & colors of the trees are spilled until the last tile is done)
+	string points_path = spill.dir+"/tree_points.tmp", colors_path = spill.dir+"/tree_colors.tmp";
+	ofstream points_out(points_path, ios::binary), colors_out(colors_path, ios::binary);
+	const string color_lines[6] = {"      0 0 1,\n", "      0 1 0,\n", "      1 0 0,\n", "      1 1 0,\n", "      0 1 1,\n", "      1 0 1,\n"}; // (same colors as the final wrl of a map)
+	long long tree_points = 0, max_tile_points = 0;
+	string buf, color_buf;
+	TileTreeMerger merger(tile_size, halo);
+	vector<pair<int,long long>> tree_of; // points of the trees of a tile, which no earlier tile wrote
+	for (int t=0; t<tiles.size(); t++) {
+		PointCloud tile;
+		{
+			StageTimer timer(segmenter.metrics, Metrics::stage_parse);
+			string path = spill.path(tiles[t]);
+			ifstream in(path, ios::binary | ios::ate);
+			vector<SpillPoint> points(in.tellg()/sizeof(SpillPoint));
+			in.seekg(0);
+			in.read((char*) points.data(), points.size()*sizeof(SpillPoint));
+			in.close();
+			remove(path.c_str());
+			tile.reserve(points.size());
+			for (int i=0; i<points.size(); i++) {tile.push_back(points[i].x, points[i].y, points[i].z, points[i].index);} // (spilled in the order of the map)
+		}
+		max_tile_points = max(max_tile_points, (long long) tile.size());
+		ClusterSet clusters;
+		segmenter.form_clusters(tile, clusters);
+		FilterResult result;
+		segmenter.filter_clusters(tile, clusters, result);
+		long long kept = merger.trees;
+		{
+			StageTimer timer(segmenter.metrics, Metrics::stage_output);
+			merger.add_tile(tiles[t].first, tiles[t].second, tile, clusters, result, tree_of);
+			kept = merger.trees-kept;
+			buf.clear();
+			color_buf.clear();
+			for (auto& pt : tree_of) {
+				append_wrl_point(buf, tile.x[pt.first], tile.y[pt.first], tile.z[pt.first]);
+				color_buf.append(color_lines[(pt.second-1)%6]);
+				labels << tile.index[pt.first] << ' ' << pt.second << '\n';
+			}
+			tree_points += tree_of.size();
+			points_out.write(buf.data(), buf.size());
+			colors_out.write(color_buf.data(), color_buf.size());
+			labels.flush();
+		}
+		double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+		cout << "[" << t+1 << "/" << tiles.size() << "] tile (" << tiles[t].first << ", " << tiles[t].second << ") done at " << fixed << setprecision(2) << seconds << " s: "
+		     << tile.size() << " points, " << clusters.size() << " clusters, " << kept << " trees" << endl;
+	}
+	points_out.close();
+	colors_out.close();
+	{ // the final wrl, laid out like the other wrl files (a color per point, with a black point at origin)
+		StageTimer timer(segmenter.metrics, Metrics::stage_output);
+		ofstream out(out_dir+"/tree_"+environment+"_final.wrl", ios::binary);
+		out << "#VRML V1.0 ascii\n\nSeparator { \n  MaterialBinding { \n        value PER_VERTEX_INDEXED \n  }\n\n  Material { \n    diffuseColor [ \n";
+		ifstream colors_in(colors_path, ios::binary);
+		if (tree_points > 0) {out << colors_in.rdbuf();}
+		out << "       0 0 0 ]\n  } \n\n  Coordinate3 { \n    point [ \n";
+		ifstream points_in(points_path, ios::binary);
+		if (tree_points > 0) {out << points_in.rdbuf();}
+		out << "       0 0 0 ]\n}\n\n  PointSet { \n    startIndex 0 \n    numPoints " << tree_points+1 << "\n  } \n} \n";
+	}
+	remove(points_path.c_str());
+	remove(colors_path.c_str());
+	rmdir(spill.dir.c_str());
+	double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+	cout << "Streamed " << num_points << " points in " << seconds << " s: " << merger.trees << " trees (" << tree_points << " points), at most " << max_tile_points << " points in memory at once" << endl;
+	if (!metrics_path.empty()) { // stage timers & counters of all tiles, as json
+		ofstream metrics_file(metrics_path);
+		metrics_file << segmenter.metrics.to_json();
+	}
 }
 
-int check_if_cluster_resides_inside_median_cylinder (vector<vector<float>>& cluster, int ul) {
-	int total_points = cluster.size();
-	// cluster_enclosing_threshold = 0.98;
-	int enclosed_points = 0;
-	vector<float> med_circle_center = {final_med_cylinder_x[ul], final_med_cylinder_y[ul]};
-	for (int f1 = 0; f1<cluster.size(); f1++) {
-		if (distance_bw_points_projection(med_circle_center, cluster[f1]) <= final_med_cylinder_r[ul]) {
-			enclosed_points++;
+void parse_options (int argc, char** argv, int first = 3) {
+	// Parses the optional arguments (given after environment_name & number_of_3Dpoints_in_the_current_environment, i.e. from argv[first])
+	for (int i=first; i<argc; i++) {
+		string opt = argv[i];
+		if ((opt == "--threads") && (i+1 < argc)) {
+			params.num_threads = stoi(argv[++i]);
+		} else if ((opt == "--seed") && (i+1 < argc)) {
+			params.rng_seed = stoll(argv[++i]);
+			if ((params.rng_seed < 0) || (params.rng_seed > UINT32_MAX)) {
+				cout << "Seed must be in 0 to " << UINT32_MAX << endl;
+				exit(1);
+			}
+		} else if ((opt == "--estimator") && (i+1 < argc) && ((string(argv[i+1]) == "exact") || (string(argv[i+1]) == "sequential"))) {
+			params.median_estimator_sequential = (string(argv[++i]) == "sequential");
+		} else if ((opt == "--median-tol") && (i+1 < argc)) {
+			params.median_tolerance = stof(argv[++i]);
+		} else if ((opt == "--circle-fit") && (i+1 < argc)) {
+			const vector<string> names = {"median", "kasa", "pratt", "taubin"}; // (in the order of circle_fit_*)
+			auto it = find(names.begin(), names.end(), string(argv[++i]));
+			if (it == names.end()) {
+				cout << "Unknown circle fit: " << argv[i] << endl;
+				exit(1);
+			}
+			params.circle_fit = it-names.begin();
+		} else if ((opt == "--ransac") && (i+1 < argc)) {
+			params.circle_fit_ransac_iterations = stoi(argv[++i]);
+		} else if ((opt == "--xy-eps") && (i+1 < argc)) {
+			params.xy_dedup_epsilon = stof(argv[++i]);
+		} else if ((opt == "--growth-limit") && (i+1 < argc)) {
+			params.growth_size_limit = stoi(argv[++i]);
+		} else if ((opt == "--cluster-tiles") && (i+1 < argc)) {
+			params.cluster_tile_size = stof(argv[++i]);
+		} else if ((opt == "--voxel") && (i+1 < argc)) {
+			params.downsample_voxel = stof(argv[++i]);
+		} else if ((opt == "--ground-cell") && (i+1 < argc)) {
+			params.ground_cell_size = stof(argv[++i]);
+		} else if ((opt == "--ground-band") && (i+1 < argc)) {
+			params.ground_band = stof(argv[++i]);
+		} else if (opt == "--shape-filters") {
+			use_shape_prefilters(params);
+		} else if (opt == "--cluster") {
+			do_clustering = 1;
+		} else if ((opt == "--tile-size") && (i+1 < argc)) {
+			stream_tile_size = stof(argv[++i]);
+		} else if ((opt == "--halo") && (i+1 < argc)) {
+			stream_halo = stof(argv[++i]);
+		} else if ((opt == "--metrics") && (i+1 < argc)) {
+			metrics_path = argv[++i];
+		} else if ((opt == "--trace") && (i+1 < argc) && ((string(argv[i+1]) == "off") || (string(argv[i+1]) == "final") || (string(argv[i+1]) == "steps"))) {
+			opt = argv[++i];
+			params.trace_level = (opt == "off") ? trace_off : ((opt == "final") ? trace_final : trace_steps);
+		} else {
+			cout << "Unknown option: " << opt << endl;
+			exit(1);
 		}
 	}
-	if (enclosed_points >= (total_points*cluster_enclosing_threshold)) {
-		return 1;
-	} else {return 0;}
 }
 
 int main (int argc, char** argv){
+	if ((argc >= 3) && (string(argv[1]) == "--batch")) {
+		parse_options(argc, argv);
+		run_batch(argv[2]);
+		return 0;
+	}
+	if ((argc >= 3) && (string(argv[1]) == "--stream")) {
+		string environment = argv[2];
+		string wrl_path = "../wrl/oakland_part"+environment+".wrl";
+		int first_option = 3;
+		if ((argc >= 4) && (argv[3][0] != '-')) {
+			wrl_path = argv[3];
+			first_option = 4;
+		}
+		parse_options(argc, argv, first_option);
+		run_stream(environment, wrl_path);
+		return 0;
+	}
+	if ((argc >= 3) && (string(argv[1]) == "--trace-to-wrl")) {
+		string environment = argv[2];
+		trace_to_wrl(environment, (argc >= 4) ? argv[3] : "generated_wrl/"+environment+"/trace.bin");
+		return 0;
+	}
+	if (argc < 3) {
+		cout << "Usage: ./code environment_name number_of_3Dpoints_in_the_current_environment [--threads N] [--seed S] [--estimator exact|sequential] [--median-tol T] [--circle-fit median|kasa|pratt|taubin] [--ransac N] [--xy-eps E] [--growth-limit N] [--cluster-tiles T] [--voxel V] [--ground-cell C] [--ground-band B] [--shape-filters] [--cluster] [--trace off|final|steps] [--metrics file.json]" << endl;
+		cout << "       ./code --batch manifest_file [options]" << endl;
+		cout << "       ./code --stream environment_name [wrl_file] [--tile-size T] [--halo H] [options]" << endl;
+		cout << "       ./code --trace-to-wrl environment_name [trace_file]" << endl;
+		exit(1);
+	}
 	string environment = argv[1];
 	int pts_in_env = stoi(argv[2]);
+	parse_options(argc, argv);
+	params.verbose = 1;
+	Segmenter segmenter(params);
+	segmenter.metrics.enabled = !metrics_path.empty();
 	clusters_path = "generated_wrl/"+environment+"/z_range_0.2_0.35_proxi_0.7/";
+	cluster_cache_path = "generated_wrl/"+environment+"/clusters.bin";
 	log_write.open ("log/enclose/log_"+environment+".txt");
 	
 	time_t start_cluster, end_cluster; 
 	// ############################# Beginning of Read WRL File #############################
-	vector<vector<float>> coordinate;
+	PointCloud coordinate; // points of the map (or, if clustering isn't done, points of all the clusters read from wrl files)
 	string file_name = "../wrl/oakland_part"+environment+".wrl";
 	// do_clustering = 0;
 	// cout << "do_clustering: "<< do_clustering << endl;
 	if (do_clustering != 0) {
-		ifstream inFile;
-		string x;
-
 		cout << "environment: " << environment << endl;
-		inFile.open(file_name);
-
-		if (!inFile) {
+		StageTimer timer(segmenter.metrics, Metrics::stage_parse);
+		if (read_wrl(file_name, coordinate, pts_in_env, 0, -1) < 0) {
 			cout << "Unable to open file" << endl;
 				exit(1); // terminate with error
 		}
 
-		int flag = 0;
-		int count = 0;
-		while (getline(inFile, x)) {
-			count ++;
-			if (count < pts_in_env) {continue;}
-			if (flag == 0) {
-				if (regex_match (x,regex (".*Coordinate3.*"))) {
-					flag = 1;
-				}
-			}
-			if (flag == 1) {
-			regex re(".*\\s(.*\\d.*)\\s(.*\\d.*)\\s(.*\\d.*)((\\,)|(\\s)).*");
-			vector<float> vec1;
-			for (sregex_iterator it = sregex_iterator(x.begin(), x.end(), re); it != sregex_iterator(); it++) {
-				smatch match;
-				match = *it;
-				vec1.push_back(stof(match.str(1)));
-				vec1.push_back(stof(match.str(2)));
-				vec1.push_back(stof(match.str(3)));
-			}
-			if (vec1.size() != 0) {coordinate.push_back(vec1);}
-			}
-		}
-
 		cout << "Size of wrl coordinate array: " << coordinate.size() << endl;
 		if (coordinate.size() < 40826) {//smallest wrl file in the datste used had 40826 points
 			cout << "Error in Reading WRL File. Exiting.";
 			return 0;
 		}
-		inFile.close();
 	}
 	//######################################### End of Read WRL File #############################
 
 	//############################# Start Grouping the 3D points into Clusters(1st part of algo) #########################################
-	vector<vector<vector<float>>> clusters; // variable to store each cluster separately
+	ClusterSet clusters; // indices (into `coordinate`) of the points of all clusters, stored cluster after cluster
 	vector<string> all_files;
 	if (do_clustering == 1) { // if clustering needs to be done (not just filtering of already available clusters), generate the clusters
 		time(&start_cluster);
-		int count1 = 0;
-		string junk;
-		int flag1, ngbrs_to_curr_pt, total_points = 0;
-		float cluster_z_range_threshold=(0.4)*(2*proximity_threshold);//hyper-parameter
-		float range,max_z,min_z;
-		int curr_set_idx, next_set_idx, curr_count = 0, temp_idx, num_steps=0;
-		while (coordinate.size() != 0) {
-			cout << "********************* Starting cluster-" << count1+1 << endl;
-			clusters.push_back({coordinate[0]});
-			coordinate.erase(coordinate.begin());
-			curr_set_idx = 0;//each set corresponds to one iteration of adding points to cluster
-			next_set_idx = 1;
-			num_steps=0;
-			curr_count=0;
-			for (int dl=0; dl<clusters[count1].size(); dl++){
-				// cout << "3x";
-				// cout << dl << " | "<< curr_set_idx << " | " << next_set_idx << " | " <<curr_count<< endl;
-				if (dl>=next_set_idx) {
-					// temp_idx = curr_set_idx;
-					curr_set_idx = next_set_idx;
-					next_set_idx = curr_set_idx+curr_count;
-					curr_count = 0;
-					// cout << dl << " | "<< curr_set_idx << " | " << next_set_idx << " | " <<curr_count<< "******" << endl;
-				}
-				flag1 = 0;
-				for (int rl=0; rl<coordinate.size(); rl++){
-					if (distance_bw_points(clusters[count1][dl],coordinate[rl]) <= proximity_threshold) {
-						clusters[count1].push_back(coordinate[rl]);
-						coordinate.erase(coordinate.begin()+rl); // removing elements from the vector `coordinate` to reduce computational intensity(becz, there is no need to check proximity of one cluster point to another cluster point)
-						rl--;
-						if ((dl>= curr_set_idx) && (dl< next_set_idx)) {// just keeping the if-condition although its redundant.
-							curr_count++;
-						}
-					}
-				}
-				tie(max_z, min_z) = cluster_z_range(clusters[count1]);
-				range = max_z-min_z;
-				if (range < cluster_z_range_threshold) { 
-					// if there is no sufficient variation in z-coordinates of the points in cluster, it means that the current cluster is a part of a horizontal surface (like road) & can't be a part of tree.
-					//  & hence discard the current cluster.
-					clusters.erase(clusters.end()-1);
-					count1--;
-					flag1=1;
-					// cout << "##### One cluster skipped.";
-					break;
-				}
-				if (dl==(next_set_idx-1)) { // if one step of growth is completed
-					// Allow the cluster to grow in all directions for one step. & then check if the cluster has any points corresponding to ground.
-					// If the cluster has points corresponding to both ground & tree, remove the ground points(so that cluster won't grow in ground direction in next step) & continue growing only in tree direction.
-					num_steps++;
-					// cout << "Enter if checking is done.";
-					// cin >> junk;
-					Visualize(clusters[count1], to_string(count1+1)+"_step"+to_string(num_steps)+"_before_gnd_removal", environment);
-					// cout << "Cluster-" << count1+1 << " size after step-"<<num_steps<<": " << clusters[count1].size() << endl;
-					cout << clusters[count1].size() << " | " ;
-					remove_ground_pts_from_cluster(clusters[count1], max_z, min_z);
-					// cout << "Cluster-" << count1+1 << " size after step-"<<num_steps<<": " << clusters[count1].size() << endl;
-					Visualize(clusters[count1], to_string(count1+1)+"_step"+to_string(num_steps)+"_after_gnd_removal", environment);
-					cout << clusters[count1].size() << " || ";
-					// cout << "One step of growing is done." << endl;
-					// cout << "1x";
-				}
-				// cout << "2x";
-			}
-			if (flag1 == 0) {
-				total_points += clusters[count1].size();
-				cout << "Number of points in current cluster = " << clusters[count1].size() << endl;
-			}
-			// cout << "4x";
-			count1++;
+		if ((params.trace_level != trace_off) && trace.open("generated_wrl/"+environment+"/trace.bin")) {
+			segmenter.trace = &trace;
+		} else if (params.trace_level != trace_off) {
+			cout << "Unable to write trace generated_wrl/" << environment << "/trace.bin" << endl;
 		}
+		segmenter.form_clusters(coordinate, clusters);
+		trace.close();
 		cout << "Total Number of clusters in '" << file_name << "': " << clusters.size() << endl;
-
-		// After accumulating 200 points, check variability of z-coordinates in cluster
-		// Don't abruptly stop expanding the cluster once its size reaches 200. Allow it to continue the current growth step & then stop to check whether there is variability in z-coordinates of the points in cluster
-		// after every step (of adding 200 points), remove points whose z-coordinates are almost similar & continue expanding same cluster.
-		// First check height(variability in z-coordinates) & then check if the obtained tall cluster is circular in XY-Plane.
-
+		{
+			StageTimer timer(segmenter.metrics, Metrics::stage_output);
+			write_cluster_cache(cluster_cache_path, coordinate, clusters.members, clusters.bounds);
+		}
+		for (int i=0; i<clusters.size(); i++) {
+			all_files.push_back(cluster_cache_path+":cluster_"+to_string(i+1));
+		}
 
 		time(&end_cluster);
 		double time_taken = double(end_cluster - start_cluster);
-		cout << "Time taken for Clustering with proximity_threshold: "<< proximity_threshold <<  " is : " << time_taken << endl;
+		cout << "Time taken for Clustering with proximity_threshold: "<< params.proximity_threshold <<  " is : " << time_taken << endl;
 	} else {
-		// If wrl files corresponding to 1st step of algo are already available, read them & proceed to 2nd step of algo.
-		vector<vector<float>> cluster_coordinate;
-		list_dir(clusters_path.c_str(), all_files);
-		int flag123;
-
-		for (int i=0; i<all_files.size(); i++) {
-			ifstream inFile;
-			string y;
-			inFile.open(all_files[i]);
-			if (!inFile) {
+		// If clusters formed in 1st step of algo are already available, read them & proceed to 2nd step of algo.
+		// They're read from the cluster cache (`cluster_cache_path`) if it exists, else from the wrl files (of the final step of growth) of each cluster.
+		int cluster_start;
+		StageTimer timer(segmenter.metrics, Metrics::stage_parse);
+		int num_cached = read_cluster_cache(cluster_cache_path, coordinate, clusters.bounds);
+		for (int i=0; i<num_cached; i++) {
+			all_files.push_back(cluster_cache_path+":cluster_"+to_string(i+1));
+		}
+		if (num_cached < 0) {list_dir(clusters_path.c_str(), all_files);}
+
+		for (int i=0; (num_cached < 0) && (i<all_files.size()); i++) {
+			cluster_start = coordinate.size(); // points of all clusters are read into `coordinate`, one cluster after another
+			//(To speeden the execution), if a cluster size is more than `cluster_size_high_threshold`, don't even read the entire wrl file corresponding to that cluster.
+			if (read_wrl(all_files[i], coordinate, 0, params.cluster_size_high_threshold+3, i+1) < 0) {
 				cout << "Unable to open file" << endl;
 				log_write << "Unable to open file\n";
 					exit(1); // terminate with error
 			}
-			flag123 = 0;
-			vector<vector<float>>().swap(cluster_coordinate);
-			while (getline(inFile, y)) {
-
-				if (regex_match (y,regex (".*Coordinate3.*"))) {flag123 = 1;}
-				if (flag123 == 0) {continue;}
-				
-				if (flag123 == 1) {
-				regex re(".*\\s(.*\\d.*)\\s(.*\\d.*)\\s(.*\\d.*)((\\,)|(\\s)).*");
-				vector<float> vec12;
-				for (sregex_iterator it = sregex_iterator(y.begin(), y.end(), re); it != sregex_iterator(); it++) {
-					smatch match;
-					match = *it;
-					vec12.push_back(stof(match.str(1)));
-					vec12.push_back(stof(match.str(2)));
-					vec12.push_back(stof(match.str(3)));
-				}
-				if (vec12.size() != 0) {cluster_coordinate.push_back(vec12);}
-				}
-				if (cluster_coordinate.size() > cluster_size_high_threshold+2) {break;} //(To speeden the execution), if a cluster size is more than `cluster_size_high_threshold`, don't even read the entire wrl file corresponding to that cluster.
-			}
-			clusters.push_back(cluster_coordinate);
+			clusters.bounds.push_back({cluster_start, coordinate.size()-cluster_start}); // (start, size) of the cluster in `coordinate`
 		}
+		clusters.members.resize(coordinate.size());
+		iota(clusters.members.begin(), clusters.members.end(), 0);
 		cout << "********* number of clusters: " << clusters.size() << endl;
 		log_write << "********* number of clusters: "+to_string(clusters.size())+"\n";
 	}
@@ -713,83 +1027,79 @@ int main (int argc, char** argv){
 	
 	// ***************************** 2nd step of algorithm ***************************** 
 	// ######################### Start filtering the clusters(2nd part of algo) #########################################
-	
-	for (int ag=0; ag<clusters.size(); ag++){ // (1st stage of filtering) Remove clusters with irrelevant sizes
-		if ((clusters[ag].size() < cluster_size_low_threshold) || (clusters[ag].size() > cluster_size_high_threshold)) {
-			clusters.erase(clusters.begin()+ag);
-			all_files.erase(all_files.begin()+ag);
-			ag--;
-		} 
-		else {
-			// valid_cluster_num++;
-			// cout << all_files[ag] << endl;
-			// cout << "size of cluster-" << ag+1 << ": " << clusters[ag].size() <<endl;
-		}
-	}
-	cout << "********* number of clusters of relevant sizes: " << clusters.size() << endl;
-	log_write << "********* number of clusters of relevant sizes: "+to_string(clusters.size())+"\n";
-
-	float median_cluster_radius, med_cyl_x, med_cyl_y;
-	int valid_cluster_num = -1;
-	string color_line;
-	int ai=0;
 	time_t start_cls_filter, end_cls_filter;
 	time(&start_cls_filter);
-	for (int al=0; al<clusters.size(); al++, ai++) {
-		valid_cluster_num++;
-		if ((al%6)==0) {valid_cluster_num=0;}
-		if (valid_cluster_num==0) {color_line = "      0 0 1,\n";}
-	    if (valid_cluster_num==1) {color_line = "      0 1 0,\n";}
-	    if (valid_cluster_num==2) {color_line = "      1 0 0,\n";}
-	    if (valid_cluster_num==3) {color_line = "      1 1 0,\n";}
-	    if (valid_cluster_num==4) {color_line = "      0 1 1,\n";}
-	    if (valid_cluster_num==5) {color_line = "      1 0 1,\n";}
-
-	    cout << endl << "***** Current cluster: " << all_files[ai] << endl;
-	    log_write << "\n***** Current cluster: "+all_files[ai]+"\n";
-		tie(med_cyl_x, med_cyl_y, median_cluster_radius) = find_median_radius(clusters[al], 1, ai, color_line);
-		if (median_cluster_radius == -121.0) {return 0;}
-		Visualize_med_cylinder(environment, "tree", 0);
-
-		// Start 2nd stage of filtering
-		if (median_cluster_radius > tree_radius_thresh){
-			clusters.erase(clusters.begin()+al);
-			al--;
-		} else {
-			final_med_cylinder_x.push_back(med_cyl_x);
-			final_med_cylinder_y.push_back(med_cyl_y);
-			final_med_cylinder_r.push_back(median_cluster_radius);
-		}
-		// End 2nd stage of filtering
+	FilterResult result;
+	segmenter.filter_clusters(coordinate, clusters, result);
+	cout << "********* number of clusters of relevant sizes & shapes: " << result.candidates.size() << endl;
+	log_write << "********* number of clusters of relevant sizes & shapes: "+to_string(result.candidates.size())+"\n";
+	for (ClusterFilter& f : segmenter.filters) { // clusters rejected by each filter run before median cylinders are found
+		if (f.needs_cylinder) {continue;}
+		int rejected = count(result.prefiltered_by.begin(), result.prefiltered_by.end(), f.id);
+		cout << "********* rejected by the " << f.name << " filter: " << rejected << endl;
+		log_write << "********* rejected by the "+f.name+" filter: "+to_string(rejected)+"\n";
 	}
-	// Start 3rd stage of filtering
-	for (int ul=0; ul<clusters.size(); ul++){
-		if (check_if_cluster_resides_inside_median_cylinder(clusters[ul], ul)) {
-			clusters.erase(clusters.begin()+ul);
-			ul--;
+
+	int valid_cluster_num = -1;
+	string color_line;
+	int al = 0; // number of clusters (of relevant sizes) so far, which passed the 2nd stage of filtering
+	{
+		StageTimer timer(segmenter.metrics, Metrics::stage_output);
+		for (int ai=0; ai<result.candidates.size(); ai++) {
+			valid_cluster_num++;
+			if ((al%6)==0) {valid_cluster_num=0;}
+			if (valid_cluster_num==0) {color_line = "      0 0 1,\n";}
+		    if (valid_cluster_num==1) {color_line = "      0 1 0,\n";}
+		    if (valid_cluster_num==2) {color_line = "      1 0 0,\n";}
+		    if (valid_cluster_num==3) {color_line = "      1 1 0,\n";}
+		    if (valid_cluster_num==4) {color_line = "      0 1 1,\n";}
+		    if (valid_cluster_num==5) {color_line = "      1 0 1,\n";}
+
+			MedianCylinder& cylinder = result.cylinders[ai];
+		    cout << endl << "***** Current cluster: " << all_files[result.candidates[ai]] << endl;
+		    log_write << "\n***** Current cluster: "+all_files[result.candidates[ai]]+"\n";
+			cout << "***** curr_cluster_num: " << ai << endl;
+			log_write << "***** curr_cluster_num: "+to_string(ai)+"\n";
+			cout << "Un-reduced cluster size: " << cylinder.num_points << endl;
+			log_write << "Un-reduced cluster size: "+to_string(cylinder.num_points)+"\n";
+			if (cylinder.converged) {
+				cout << "Median cylinder converged after " << cylinder.num_circles << " circles" << endl;
+				log_write << "Median cylinder converged after "+to_string(cylinder.num_circles)+" circles\n";
+			}
+			cout << "Radius of median cylinder: " << cylinder.r << endl;
+			log_write << "Radius of median cylinder: "+to_string(cylinder.r)+"\n";
+			generate_cluster_data(coordinate, clusters[result.candidates[ai]], cylinder, color_line);
+			if (result.rejected_by[ai] != filter_radius) {al++;}
 		}
+		if (!result.candidates.empty()) {Visualize_med_cylinder(environment, "tree", 0);}
 	}
-	// End 3rd stage of filtering
 
 	time(&end_cls_filter);
 	cout << "Time taken for filtering the clusters is : " << double(end_cls_filter-start_cls_filter) << endl;
 	log_write << "Time taken for filtering the clusters is : " + to_string(float(end_cls_filter-start_cls_filter))+"\n";
 
 	// Visualize the final output of the algo
-	valid_cluster_num = -1;
-	for (int al=0; al<clusters.size(); al++) {
-		valid_cluster_num++;
-		if ((al%6)==0) {valid_cluster_num=0;}
-		if (valid_cluster_num==0) {color_line = "      0 0 1,\n";}
-	    if (valid_cluster_num==1) {color_line = "      0 1 0,\n";}
-	    if (valid_cluster_num==2) {color_line = "      1 0 0,\n";}
-	    if (valid_cluster_num==3) {color_line = "      1 1 0,\n";}
-	    if (valid_cluster_num==4) {color_line = "      0 1 1,\n";}
-	    if (valid_cluster_num==5) {color_line = "      1 0 1,\n";}
-		generate_final_data(clusters[al], 1, al, color_line);
-		Visualize_med_cylinder(environment, "tree", 1);
+	{
+		StageTimer timer(segmenter.metrics, Metrics::stage_output);
+		valid_cluster_num = -1;
+		for (int al=0; al<result.trees.size(); al++) {
+			valid_cluster_num++;
+			if ((al%6)==0) {valid_cluster_num=0;}
+			if (valid_cluster_num==0) {color_line = "      0 0 1,\n";}
+		    if (valid_cluster_num==1) {color_line = "      0 1 0,\n";}
+		    if (valid_cluster_num==2) {color_line = "      1 0 0,\n";}
+		    if (valid_cluster_num==3) {color_line = "      1 1 0,\n";}
+		    if (valid_cluster_num==4) {color_line = "      0 1 1,\n";}
+		    if (valid_cluster_num==5) {color_line = "      1 0 1,\n";}
+			generate_final_data(coordinate, clusters[result.candidates[result.trees[al]]], 1, al, color_line);
+		}
+		if (!result.trees.empty()) {Visualize_med_cylinder(environment, "tree", 1);}
 	}
 	// ######################### END filtering the clusters #########################################
 	log_write.close();
+	if (!metrics_path.empty()) { // stage timers & counters of the run, as json
+		ofstream metrics_file(metrics_path);
+		metrics_file << segmenter.metrics.to_json();
+	}
 	return 0;
 }
@@ -0,0 +1,1614 @@
+// treeseg: implementation of the segmentation algorithm (see treeseg.h).
+
+#include "treeseg.h"
+#include <bits/stdc++.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+void remove_ground_pts_from_cluster(PointCloud& cloud, vector<int>& curr_cluster, ClusterStats& stats, float z_coord_threshold, float num_points_threshold, vector<int>* removed) {
+	//if Number of pts having their z-coordinate in the bottom 20% of the range (min_z, max_z) is more than 35% of all the points in the cluster, then remove all those pts (whose z-coordinates lie in the bottom 20% of the range (min_z, max_z))
+	//we hope to remove all the ground points which are surrounding the base of the trunk(in worst case, a few points at the base of the trunk too).
+	//These 20% & 35% are tunable parameters, passed in z_coord_threshold & num_points_threshold respectively (ground_z_band_fraction & ground_points_fraction of SegmenterParams).
+	//Number of points in the bottom band is found from the histogram of z. Only if the bin containing the top of the band decides whether the count crosses 35%, are the points counted one by one.
+	//The points are removed in a single (stable) pass over the cluster, which also finds the new min & max of z.
+	//If `removed` is given, the removed points are appended to it (used for the clustering trace).
+
+	float max_z = stats.max_z, min_z = stats.min_z;
+	float band_top = min_z+z_coord_threshold*(max_z-min_z);
+	int top_bin = stats.bin_of(band_top);
+	int count = stats.count_in_bins_below(top_bin); // all these points are in the band (all points are >= min_z)
+	int count_in_top_bin = ((top_bin >= stats.first_bin) && (top_bin-stats.first_bin < stats.hist.size())) ? stats.hist[top_bin-stats.first_bin] : 0;
+	if ((count+count_in_top_bin) < (curr_cluster.size()*num_points_threshold)) {return;} // not enough points in the band, even if all points of the top bin are in the band
+	if (count < (curr_cluster.size()*num_points_threshold)) {
+		count = 0;
+		for (int ml=0; ml<curr_cluster.size(); ml++){
+			if ((cloud.z[curr_cluster[ml]] >= min_z) && (cloud.z[curr_cluster[ml]] <= band_top)) {
+				count++;
+			}
+		}
+	}
+	if (count >= (curr_cluster.size()*num_points_threshold)) {
+		stats.max_z = -1000;
+		stats.min_z = 1000;
+		int kept = 0;
+		for (int rl=0; rl<curr_cluster.size(); rl++){
+			float z = cloud.z[curr_cluster[rl]];
+			if ((z >= min_z) && (z <= band_top)) {
+				stats.remove(z);
+				if (removed != NULL) {removed->push_back(curr_cluster[rl]);}
+			} else {
+				curr_cluster[kept++] = curr_cluster[rl];
+				if (z>stats.max_z){stats.max_z = z;}
+				if (z<stats.min_z){stats.min_z = z;}
+			}
+		}
+		curr_cluster.resize(kept);
+	}
+	return;
+}
+
+float distance_bw_points (PointCloud& cloud, int point1, int point2) {
+	return sqrt(pow((cloud.x[point1]-cloud.x[point2]),2)+pow((cloud.y[point1]-cloud.y[point2]),2)+pow((cloud.z[point1]-cloud.z[point2]),2));
+}
+
+// Uniform voxel-hash grid over all the points of the map, used to find neighbors of a cluster point while growing the cluster.
+// Cell size is `proximity_threshold`, so all neighbors of a point lie in the 27 cells around (& including) the point's own cell.
+// Points which are claimed by a cluster are removed from the grid in O(1) (by swapping with the last point of their cell), so that they're never scanned again.
+struct VoxelGrid {
+	float cell_size;
+	unordered_map<long long, vector<int>> cells; // cell key -> indices of the unclaimed points lying in the cell
+	vector<long long> point_cell; // cell key of each point
+	vector<int> point_slot; // position of each point in its cell's vector (-1 once the point is removed from the grid)
+	long long distance_evals = 0; // number of distances computed by radius_query
+
+	int cell_coord(float v) {
+		return (int)floor(v/cell_size);
+	}
+
+	long long cell_key(int cx, int cy, int cz) { // 21 bits per axis is more than enough for any map
+		return (((long long)cx & 0x1FFFFF) << 42) | (((long long)cy & 0x1FFFFF) << 21) | ((long long)cz & 0x1FFFFF);
+	}
+
+	void build(PointCloud& points, float size) {
+		cell_size = size;
+		cells.clear();
+		point_cell.resize(points.size());
+		point_slot.resize(points.size());
+		for (int i=0; i<points.size(); i++) {
+			long long key = cell_key(cell_coord(points.x[i]), cell_coord(points.y[i]), cell_coord(points.z[i]));
+			vector<int>& cell = cells[key];
+			point_cell[i] = key;
+			point_slot[i] = cell.size();
+			cell.push_back(i);
+		}
+	}
+
+	bool contains(int idx) {
+		return point_slot[idx] != -1;
+	}
+
+	void remove(int idx) {
+		vector<int>& cell = cells[point_cell[idx]];
+		int slot = point_slot[idx];
+		int last = cell.back();
+		cell[slot] = last;
+		point_slot[last] = slot;
+		cell.pop_back();
+		point_slot[idx] = -1;
+	}
+
+	// Appends (to `ngbrs`) indices of all the points still in the grid that are within `radius` of the point `point`.
+	// Uses `distance_bw_points`, so that the neighbors found are exactly the same as those found by a scan over all points.
+	void radius_query(int point, PointCloud& points, float radius, vector<int>& ngbrs) {
+		distance_evals += find_neighbors(point, points, radius, ngbrs);
+	}
+
+	// Same as radius_query, but doesn't change the grid (so it can be called from several threads at once). Returns the number of distances computed.
+	long long find_neighbors(int point, PointCloud& points, float radius, vector<int>& ngbrs) {
+		int px = cell_coord(points.x[point]), py = cell_coord(points.y[point]), pz = cell_coord(points.z[point]);
+		long long evals = 0;
+		for (int dx=-1; dx<=1; dx++) {
+			for (int dy=-1; dy<=1; dy++) {
+				for (int dz=-1; dz<=1; dz++) {
+					auto it = cells.find(cell_key(px+dx, py+dy, pz+dz));
+					if (it == cells.end()) {continue;}
+					evals += it->second.size();
+					for (int idx : it->second) {
+						if (distance_bw_points(points, point, idx) <= radius) {
+							ngbrs.push_back(idx);
+						}
+					}
+				}
+			}
+		}
+		return evals;
+	}
+};
+
+// ************************** Batched circle fitting (used to find the median cylinder of a cluster) **************************
+// The circle passing through the XY-plane projections of 3 points (x0,y0), (x1,y1), (x2,y2) has center (s,t) & radius sqrt(s^2+t^2-u), where (s,t,u) solves
+// 		2*xi*s + 2*yi*t - u = xi^2+yi^2 (i = 0,1,2)
+// The system is solved with Cramer's rule. Triples are processed in batches stored as structure-of-arrays, so that 8 (AVX2) or 4 (SSE) triples are solved per instruction.
+// Same as before: if 3 points are collinear (determinant is 0) or s^2+t^2-u < 0, there is no circle. If the radius is NaN, a large number (100000) is used as radius.
+// All 3 versions (AVX2, SSE & scalar) do exactly the same float operations in the same order, so their results are identical.
+// (They're compiled with fp-contract=off: else, with e.g. -march=native, the compiler fuses some multiplications & additions into FMAs, which round differently.)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+void fit_circles_scalar(CircleBatch& b, int first) {
+	const float c = -1;
+	for (int i=first; i<b.size; i++) {
+		float a0 = 2*b.x0[i], b0 = 2*b.y0[i], d0 = b.x0[i]*b.x0[i]+b.y0[i]*b.y0[i];
+		float a1 = 2*b.x1[i], b1 = 2*b.y1[i], d1 = b.x1[i]*b.x1[i]+b.y1[i]*b.y1[i];
+		float a2 = 2*b.x2[i], b2 = 2*b.y2[i], d2 = b.x2[i]*b.x2[i]+b.y2[i]*b.y2[i];
+		float D = a0*(b1*c-b2*c) - b0*(a1*c-a2*c) + c*(a1*b2-a2*b1);
+		float D1 = d0*(b1*c-b2*c) - b0*(d1*c-d2*c) + c*(d1*b2-d2*b1);
+		float D2 = a0*(d1*c-d2*c) - d0*(a1*c-a2*c) + c*(a1*d2-a2*d1);
+		float D3 = a0*(b1*d2-b2*d1) - b0*(a1*d2-a2*d1) + d0*(a1*b2-a2*b1);
+		float s = D1/D, t = D2/D, u = D3/D;
+		float temp31 = s*s+t*t-u;
+		float r = sqrt(temp31);
+		b.s[i] = s;
+		b.t[i] = t;
+		b.r[i] = (r != r) ? 100000.0f : r;
+		b.valid[i] = (D != 0) && !(temp31 < 0);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+void fit_circles_avx2(CircleBatch& b) {
+	const __m256 two = _mm256_set1_ps(2), c = _mm256_set1_ps(-1), zero = _mm256_setzero_ps(), big = _mm256_set1_ps(100000.0f);
+	int i = 0;
+	for (; i+8<=b.size; i+=8) {
+		__m256 x0 = _mm256_load_ps(b.x0+i), y0 = _mm256_load_ps(b.y0+i);
+		__m256 x1 = _mm256_load_ps(b.x1+i), y1 = _mm256_load_ps(b.y1+i);
+		__m256 x2 = _mm256_load_ps(b.x2+i), y2 = _mm256_load_ps(b.y2+i);
+		__m256 a0 = _mm256_mul_ps(two, x0), b0 = _mm256_mul_ps(two, y0), d0 = _mm256_add_ps(_mm256_mul_ps(x0, x0), _mm256_mul_ps(y0, y0));
+		__m256 a1 = _mm256_mul_ps(two, x1), b1 = _mm256_mul_ps(two, y1), d1 = _mm256_add_ps(_mm256_mul_ps(x1, x1), _mm256_mul_ps(y1, y1));
+		__m256 a2 = _mm256_mul_ps(two, x2), b2 = _mm256_mul_ps(two, y2), d2 = _mm256_add_ps(_mm256_mul_ps(x2, x2), _mm256_mul_ps(y2, y2));
+		__m256 bc = _mm256_sub_ps(_mm256_mul_ps(b1, c), _mm256_mul_ps(b2, c)); // b1*c-b2*c
+		__m256 ac = _mm256_sub_ps(_mm256_mul_ps(a1, c), _mm256_mul_ps(a2, c)); // a1*c-a2*c
+		__m256 dc = _mm256_sub_ps(_mm256_mul_ps(d1, c), _mm256_mul_ps(d2, c)); // d1*c-d2*c
+		__m256 ab = _mm256_sub_ps(_mm256_mul_ps(a1, b2), _mm256_mul_ps(a2, b1)); // a1*b2-a2*b1
+		__m256 db = _mm256_sub_ps(_mm256_mul_ps(d1, b2), _mm256_mul_ps(d2, b1)); // d1*b2-d2*b1
+		__m256 ad = _mm256_sub_ps(_mm256_mul_ps(a1, d2), _mm256_mul_ps(a2, d1)); // a1*d2-a2*d1
+		__m256 bd = _mm256_sub_ps(_mm256_mul_ps(b1, d2), _mm256_mul_ps(b2, d1)); // b1*d2-b2*d1
+		__m256 D = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(a0, bc), _mm256_mul_ps(b0, ac)), _mm256_mul_ps(c, ab));
+		__m256 D1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(d0, bc), _mm256_mul_ps(b0, dc)), _mm256_mul_ps(c, db));
+		__m256 D2 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(a0, dc), _mm256_mul_ps(d0, ac)), _mm256_mul_ps(c, ad));
+		__m256 D3 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(a0, bd), _mm256_mul_ps(b0, ad)), _mm256_mul_ps(d0, ab));
+		__m256 s = _mm256_div_ps(D1, D), t = _mm256_div_ps(D2, D), u = _mm256_div_ps(D3, D);
+		__m256 temp31 = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(s, s), _mm256_mul_ps(t, t)), u);
+		__m256 r = _mm256_sqrt_ps(temp31);
+		r = _mm256_blendv_ps(r, big, _mm256_cmp_ps(r, r, _CMP_UNORD_Q));
+		__m256 valid = _mm256_andnot_ps(_mm256_cmp_ps(temp31, zero, _CMP_LT_OQ), _mm256_cmp_ps(D, zero, _CMP_NEQ_UQ));
+		_mm256_store_ps(b.s+i, s);
+		_mm256_store_ps(b.t+i, t);
+		_mm256_store_ps(b.r+i, r);
+		_mm256_store_si256((__m256i*) (b.valid+i), _mm256_castps_si256(valid));
+	}
+	fit_circles_scalar(b, i);
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+void fit_circles_sse(CircleBatch& b) {
+	const __m128 two = _mm_set1_ps(2), c = _mm_set1_ps(-1), zero = _mm_setzero_ps(), big = _mm_set1_ps(100000.0f);
+	int i = 0;
+	for (; i+4<=b.size; i+=4) {
+		__m128 x0 = _mm_load_ps(b.x0+i), y0 = _mm_load_ps(b.y0+i);
+		__m128 x1 = _mm_load_ps(b.x1+i), y1 = _mm_load_ps(b.y1+i);
+		__m128 x2 = _mm_load_ps(b.x2+i), y2 = _mm_load_ps(b.y2+i);
+		__m128 a0 = _mm_mul_ps(two, x0), b0 = _mm_mul_ps(two, y0), d0 = _mm_add_ps(_mm_mul_ps(x0, x0), _mm_mul_ps(y0, y0));
+		__m128 a1 = _mm_mul_ps(two, x1), b1 = _mm_mul_ps(two, y1), d1 = _mm_add_ps(_mm_mul_ps(x1, x1), _mm_mul_ps(y1, y1));
+		__m128 a2 = _mm_mul_ps(two, x2), b2 = _mm_mul_ps(two, y2), d2 = _mm_add_ps(_mm_mul_ps(x2, x2), _mm_mul_ps(y2, y2));
+		__m128 bc = _mm_sub_ps(_mm_mul_ps(b1, c), _mm_mul_ps(b2, c));
+		__m128 ac = _mm_sub_ps(_mm_mul_ps(a1, c), _mm_mul_ps(a2, c));
+		__m128 dc = _mm_sub_ps(_mm_mul_ps(d1, c), _mm_mul_ps(d2, c));
+		__m128 ab = _mm_sub_ps(_mm_mul_ps(a1, b2), _mm_mul_ps(a2, b1));
+		__m128 db = _mm_sub_ps(_mm_mul_ps(d1, b2), _mm_mul_ps(d2, b1));
+		__m128 ad = _mm_sub_ps(_mm_mul_ps(a1, d2), _mm_mul_ps(a2, d1));
+		__m128 bd = _mm_sub_ps(_mm_mul_ps(b1, d2), _mm_mul_ps(b2, d1));
+		__m128 D = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(a0, bc), _mm_mul_ps(b0, ac)), _mm_mul_ps(c, ab));
+		__m128 D1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(d0, bc), _mm_mul_ps(b0, dc)), _mm_mul_ps(c, db));
+		__m128 D2 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(a0, dc), _mm_mul_ps(d0, ac)), _mm_mul_ps(c, ad));
+		__m128 D3 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(a0, bd), _mm_mul_ps(b0, ad)), _mm_mul_ps(d0, ab));
+		__m128 s = _mm_div_ps(D1, D), t = _mm_div_ps(D2, D), u = _mm_div_ps(D3, D);
+		__m128 temp31 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(s, s), _mm_mul_ps(t, t)), u);
+		__m128 r = _mm_sqrt_ps(temp31);
+		__m128 is_nan = _mm_cmpunord_ps(r, r);
+		r = _mm_or_ps(_mm_and_ps(is_nan, big), _mm_andnot_ps(is_nan, r));
+		__m128 valid = _mm_andnot_ps(_mm_cmplt_ps(temp31, zero), _mm_cmpneq_ps(D, zero));
+		_mm_store_ps(b.s+i, s);
+		_mm_store_ps(b.t+i, t);
+		_mm_store_ps(b.r+i, r);
+		_mm_store_si128((__m128i*) (b.valid+i), _mm_castps_si128(valid));
+	}
+	fit_circles_scalar(b, i);
+}
+#pragma GCC pop_options
+#endif
+#pragma GCC pop_options
+
+void fit_circles(CircleBatch& b) {
+	// Fits circles to all triples in the batch, with the widest instruction set the CPU supports.
+#if defined(__x86_64__) || defined(__i386__)
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	static const bool has_sse2 = __builtin_cpu_supports("sse2");
+	if (has_avx2) {
+		fit_circles_avx2(b);
+		return;
+	}
+	if (has_sse2) {
+		fit_circles_sse(b);
+		return;
+	}
+#endif
+	fit_circles_scalar(b, 0);
+}
+// ******************************************************************************************************************
+
+long long quantized_xy_key(float x, float y, float xy_dedup_epsilon) {
+	// Key of the (x,y) pair, quantized to a grid of `xy_dedup_epsilon` (exact float values if `xy_dedup_epsilon` <= 0)
+	uint32_t qx, qy;
+	if (xy_dedup_epsilon > 0) {
+		qx = (uint32_t) (int32_t) llround(x/xy_dedup_epsilon);
+		qy = (uint32_t) (int32_t) llround(y/xy_dedup_epsilon);
+	} else {
+		memcpy(&qx, &x, sizeof(qx));
+		memcpy(&qy, &y, sizeof(qy));
+	}
+	return (long long) (((uint64_t) qx << 32) | qy);
+}
+
+float median_of(vector<float>& samples) {
+	// Median of `samples` (which mustn't be empty). Reorders `samples`.
+	// Since we want to find the median, it is enough to sort the vector only till middle element (& for an even size, the largest element before the middle one is the other middle element).
+	size_t mid = samples.size()/2;
+	std::nth_element(samples.begin(), samples.begin()+mid, samples.end());
+	if ((samples.size()%2) == 1) {return samples[mid];}
+	return (*std::max_element(samples.begin(), samples.begin()+mid)+samples[mid])/2.0;
+}
+
+void median_confidence_interval(vector<float>& samples, float median_confidence_z, float& lo, float& hi) {
+	// Distribution-free confidence interval of the median of `samples`: the order statistics at n/2 -/+ z*sqrt(n)/2 (normal approximation of the binomial distribution of the rank of the median).
+	// Reorders `samples`.
+	long long n = samples.size();
+	long long half_width = (long long) ceil(median_confidence_z*sqrt((double) n)/2);
+	long long k_lo = max(0LL, n/2-half_width), k_hi = min(n-1, n/2+half_width);
+	std::nth_element(samples.begin(), samples.begin()+k_hi, samples.end());
+	hi = samples[k_hi];
+	std::nth_element(samples.begin(), samples.begin()+k_lo, samples.begin()+k_hi);
+	lo = samples[k_lo];
+}
+
+bool median_cylinder_converged(vector<float>& cylinder_x, vector<float>& cylinder_y, vector<float>& cylinder_r, const SegmenterParams& params) {
+	// (sequential estimator) Checks if enough circles are drawn to know the median cylinder well enough.
+	float lo_x, hi_x, lo_y, hi_y, lo_r, hi_r;
+	median_confidence_interval(cylinder_r, params.median_confidence_z, lo_r, hi_r);
+	if (lo_r > params.tree_radius_thresh) {return true;} // cluster will surely be discarded in the 2nd stage of filtering
+	median_confidence_interval(cylinder_x, params.median_confidence_z, lo_x, hi_x);
+	median_confidence_interval(cylinder_y, params.median_confidence_z, lo_y, hi_y);
+	float tol = params.median_tolerance;
+	return ((hi_r-lo_r) <= tol) && ((hi_x-lo_x) <= tol) && ((hi_y-lo_y) <= tol);
+}
+
+long long count_combinations(long long num_elements) {
+	// Number of (ordered) combinations of 3 distinct points out of `num_elements` points, saturated at LLONG_MAX (instead of overflowing for large clusters).
+	if (num_elements < 3) {return 0;}
+	unsigned long long a = num_elements, b = num_elements-1, c = num_elements-2;
+	if (a > (unsigned long long) LLONG_MAX/b/c) {return LLONG_MAX;}
+	return a*b*c;
+}
+
+inline uint64_t splitmix64(uint64_t x) {
+	// Finalizer of SplitMix64: a bijective mix of the 64 bits of x (consecutive x give independent-looking outputs).
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+inline uint32_t uniform_below(uint64_t r, uint32_t n) {
+	// Maps 32 random bits of r to [0, n) by a multiply & shift (bias < n/2^32, which is negligible for a cluster, instead of a rejection loop).
+	return (uint32_t) (((r >> 32)*n) >> 32);
+}
+
+// Draws random combinations of 3 distinct points (as indices into the reduced cluster) a batch at a time, as they are needed.
+// (Earlier, all the combinations were generated & stored before fitting any circle, which took hundreds of MB of memory per cluster.)
+// The generator is counter-based: combination i of a cluster is a pure function of (seed, cluster number, i), so a cluster gets the same
+// combinations whatever thread draws them & in whatever order, & there is no generator state to set up per cluster.
+// The 2nd & 3rd points are drawn among the points not drawn yet (by skipping over the drawn ones), so there are no rejection loops & a batch is
+// a branch-free loop over i.
+struct TripleSampler {
+	uint64_t key; // hash of (seed, cluster number)
+	uint32_t n; // number of points
+	long long drawn = 0; // number of combinations drawn so far
+	long long remaining; // number of combinations still to be drawn
+
+	TripleSampler(long long num_elements, int curr_cluster_num, int combinations_threshold, long long rng_seed) {
+		// Instead of taking all possible combinations of 3 points from the cluster, take 1000000 random combinations & use them to find the median cylinder.
+		// This reduces the computational intensity & also found that, this wouldn't change the median_radius much.
+		long long actual_combinations = count_combinations(num_elements);
+		if (actual_combinations > combinations_threshold) {
+			remaining = combinations_threshold;
+		} else {
+			remaining = actual_combinations;
+		}
+		n = num_elements;
+		uint64_t seed = rng_seed;
+		if (rng_seed == rng_unseeded) { // different combinations across executions
+			std::random_device rd;
+			seed = ((uint64_t) rd() << 32) ^ rd() ^ (uint64_t) std::chrono::high_resolution_clock::now().time_since_epoch().count();
+		}
+		key = splitmix64(splitmix64(seed) ^ (uint32_t) curr_cluster_num);
+	}
+
+	int next_batch(int* index1, int* index2, int* index3, int max_count) {
+		// Draws up to `max_count` combinations into index1/2/3[0..] & returns the number of combinations drawn (0 once all are drawn).
+		int count = (int) min((long long) max_count, remaining);
+		uint64_t base = key+3*(uint64_t) drawn*0x9E3779B97F4A7C15ULL;
+		for (int i=0; i<count; i++) {
+			uint64_t ctr = base+3*(uint64_t) i*0x9E3779B97F4A7C15ULL; // (3 random words per combination)
+			uint32_t a = uniform_below(splitmix64(ctr), n);
+			uint32_t b = uniform_below(splitmix64(ctr+0x9E3779B97F4A7C15ULL), n-1);
+			uint32_t c = uniform_below(splitmix64(ctr+2*0x9E3779B97F4A7C15ULL), n-2);
+			b += (b >= a); // b-th of the points other than a
+			uint32_t lo = min(a, b), hi = max(a, b);
+			c += (c >= lo);
+			c += (c >= hi); // c-th of the points other than a & b
+			index1[i] = a;
+			index2[i] = b;
+			index3[i] = c;
+		}
+		drawn += count;
+		remaining -= count;
+		return count;
+	}
+};
+
+float distance_bw_points_projection (float x1, float y1, float x2, float y2) {
+	return sqrt(pow((x1-x2),2)+pow((y1-y2),2));
+}
+
+bool fit_circle_algebraic (PointCloud& cloud, const int* pts, int n, int method, float& cx, float& cy, float& r) {
+	// Moments of the points (centered at their mean, for numerical stability), then (as in Chernov's "Circular & linear regression"):
+	// 	Kasa: minimizes the sum of (d_i^2-r^2)^2, a linear system (biased towards small circles when only an arc is covered).
+	// 	Pratt & Taubin: the same algebraic distance, normalized by the gradient of the circle's equation, which removes most of the bias.
+	// 		Each is the root of a polynomial (of degree 4 for Pratt & 3 for Taubin), found with Newton's method from 0.
+	if (n < 3) {return false;}
+	double mx = 0, my = 0;
+	for (int i=0; i<n; i++) {
+		mx += cloud.x[pts[i]];
+		my += cloud.y[pts[i]];
+	}
+	mx /= n;
+	my /= n;
+	double Mxx = 0, Myy = 0, Mxy = 0, Mxz = 0, Myz = 0, Mzz = 0;
+	for (int i=0; i<n; i++) {
+		double x = cloud.x[pts[i]]-mx, y = cloud.y[pts[i]]-my, z = x*x+y*y;
+		Mxx += x*x;
+		Myy += y*y;
+		Mxy += x*y;
+		Mxz += x*z;
+		Myz += y*z;
+		Mzz += z*z;
+	}
+	Mxx /= n;
+	Myy /= n;
+	Mxy /= n;
+	Mxz /= n;
+	Myz /= n;
+	Mzz /= n;
+	double Mz = Mxx+Myy, Cov_xy = Mxx*Myy-Mxy*Mxy;
+	double root = 0; // x of the circle's equation (0 for Kasa)
+	if (method == circle_fit_pratt) {
+		double A2 = 4*Cov_xy-3*Mz*Mz-Mzz;
+		double A1 = Mzz*Mz+4*Cov_xy*Mz-Mxz*Mxz-Myz*Myz-Mz*Mz*Mz;
+		double A0 = Mxz*Mxz*Myy+Myz*Myz*Mxx-Mzz*Cov_xy-2*Mxz*Myz*Mxy+Mz*Mz*Cov_xy;
+		double y = A0;
+		for (int iter=0; iter<100; iter++) {
+			double dy = A1+root*(2*A2+16*root*root);
+			double next = root-y/dy;
+			if (!isfinite(next) || (next == root)) {break;}
+			double next_y = A0+next*(A1+next*(A2+4*next*next));
+			if (abs(next_y) >= abs(y)) {break;}
+			root = next;
+			y = next_y;
+		}
+	} else if (method == circle_fit_taubin) {
+		double Var_z = Mzz-Mz*Mz;
+		double A3 = 4*Mz, A2 = -3*Mz*Mz-Mzz;
+		double A1 = Var_z*Mz+4*Cov_xy*Mz-Mxz*Mxz-Myz*Myz;
+		double A0 = Mxz*(Mxz*Myy-Myz*Mxy)+Myz*(Myz*Mxx-Mxz*Mxy)-Var_z*Cov_xy;
+		double y = A0;
+		for (int iter=0; iter<100; iter++) {
+			double dy = A1+root*(2*A2+3*A3*root);
+			double next = root-y/dy;
+			if (!isfinite(next) || (next == root)) {break;}
+			double next_y = A0+next*(A1+next*(A2+next*A3));
+			if (abs(next_y) >= abs(y)) {break;}
+			root = next;
+			y = next_y;
+		}
+	}
+	double det = root*root-root*Mz+Cov_xy;
+	if (!(abs(det) > 1e-12*max(1.0, Mz*Mz))) {return false;} // collinear (or a single point)
+	double x0 = (Mxz*(Myy-root)-Myz*Mxy)/det/2, y0 = (Myz*(Mxx-root)-Mxz*Mxy)/det/2;
+	double r2 = x0*x0+y0*y0+Mz+((method == circle_fit_pratt) ? 2*root : 0);
+	if (!(r2 >= 0) || !isfinite(r2)) {return false;}
+	cx = x0+mx;
+	cy = y0+my;
+	r = sqrt(r2);
+	return true;
+}
+
+void fit_circle_to_cluster (PointCloud& cloud, const vector<int>& points, int curr_cluster_num, const SegmenterParams& params, MedianCylinder& result) {
+	// Algebraic curvature engine (params.circle_fit != circle_fit_median): one circle fit to the (unique) XY-projections of the cluster.
+	// With RANSAC, circles through random combinations of 3 points are scored by their number of inliers & the circle is refit to the inliers of the best one.
+	float cx, cy, r;
+	result.num_triples = 0;
+	result.num_circles = 0;
+	const int* fit_points = points.data();
+	int num_fit_points = points.size();
+	vector<int> inliers, best_inliers;
+	if (params.circle_fit_ransac_iterations > 0) {
+		TripleSampler sampler(points.size(), curr_cluster_num, params.circle_fit_ransac_iterations, params.rng_seed);
+		CircleBatch batch;
+		int index1[circle_batch_size], index2[circle_batch_size], index3[circle_batch_size];
+		float tol = params.circle_fit_ransac_tolerance;
+		while ((batch.size = sampler.next_batch(index1, index2, index3, circle_batch_size)) > 0) {
+			result.num_triples += batch.size;
+			for (int yb = 0; yb < batch.size; yb++) {
+				int p0 = points[index1[yb]], p1 = points[index2[yb]], p2 = points[index3[yb]];
+				batch.x0[yb] = cloud.x[p0];
+				batch.y0[yb] = cloud.y[p0];
+				batch.x1[yb] = cloud.x[p1];
+				batch.y1[yb] = cloud.y[p1];
+				batch.x2[yb] = cloud.x[p2];
+				batch.y2[yb] = cloud.y[p2];
+			}
+			fit_circles(batch);
+			for (int yb = 0; yb < batch.size; yb++) {
+				if (!batch.valid[yb]) {continue;}
+				result.num_circles++;
+				inliers.clear();
+				for (int i=0; i<points.size(); i++) {
+					float d = distance_bw_points_projection(batch.s[yb], batch.t[yb], cloud.x[points[i]], cloud.y[points[i]]);
+					if (abs(d-batch.r[yb]) <= tol) {inliers.push_back(points[i]);}
+				}
+				if (inliers.size() > best_inliers.size()) {swap(inliers, best_inliers);}
+			}
+		}
+		if (best_inliers.size() >= 3) {
+			fit_points = best_inliers.data();
+			num_fit_points = best_inliers.size();
+		}
+	}
+	if (fit_circle_algebraic(cloud, fit_points, num_fit_points, params.circle_fit, cx, cy, r)) {
+		result.x = cx;
+		result.y = cy;
+		result.r = r;
+	} else { // no circle (all points are collinear), so the radius is infinite
+		result.x = cloud.x[points[0]];
+		result.y = cloud.y[points[0]];
+		result.r = 100000.0;
+	}
+}
+
+void find_median_radius (PointCloud& cloud, IndexSpan cluster, int curr_cluster_num, const SegmenterParams& params, MedianCylinder& result) {
+	// To get an estimate of the cluster's curvature, find the median of radii of circles passing through XY-plane projections of all possible 3-point combinations from the cluster.
+	// This is better than finding a circle which encloses the cluster, because of robustness to outliers & being influenced by most points.
+	// Finding circles which pass through all possible 3-point combinations is computationally very expensive.
+	// So, the following 2 steps are taken to reduce the compytational intensity:
+	// 1) After projecting all points onto XY-plane, consider only unique points. (But, found that, this didn't reduce the intensity to a satisfactory level. Hence, the next step.)
+	// 2) Take only 10^6 random combinations instead of all possible cobinatins.
+	// The z-range of the cluster is also found, so that the median cylinder can be drawn around the cluster.
+	// Everything is written into `result` (& nothing into globals), so this function can be called for different clusters concurrently.
+	float max_z = -1000;
+	float min_z = 1000;
+	int pl;
+	result.converged = false;
+
+	// Reducing cluster to have only points with unique X,Y coordinates (a point is dropped if a point with the same (x,y) pair, quantized to `xy_dedup_epsilon`, is already in the reduced cluster).
+	// This reduces the computational intensity & also found that, this wouldn't change the median_radius much.
+	unordered_set<long long> reduced_cluster_xy; // quantized (x,y) pairs of the points in the reduced cluster
+	reduced_cluster_xy.reserve(cluster.size());
+	vector<int> reduced_cluster; // indices (into `cloud`) of the points in the reduced cluster
+	for (pl=0; pl<cluster.size(); pl++ ){
+		int pt = cluster[pl];
+		if (reduced_cluster_xy.insert(quantized_xy_key(cloud.x[pt], cloud.y[pt], params.xy_dedup_epsilon)).second) {
+			reduced_cluster.push_back(pt);
+		}
+		if (cloud.z[pt]>max_z){max_z = cloud.z[pt];}
+		if (cloud.z[pt]<min_z){min_z = cloud.z[pt];}
+	}
+	// cout << "Reduced cluster size: " << reduced_cluster.size() << endl;
+	//############ END ###################
+	result.num_points = cluster.size();
+	result.min_z = min_z;
+	result.max_z = max_z;
+	if (params.circle_fit != circle_fit_median) {
+		fit_circle_to_cluster(cloud, reduced_cluster, curr_cluster_num, params, result);
+		return;
+	}
+	
+	TripleSampler sampler(reduced_cluster.size(), curr_cluster_num, params.combinations_threshold, params.rng_seed);
+	vector<float> avg_cylinder_x; //cumulate all obtained cylinders & find the median
+	vector<float> avg_cylinder_y;
+	vector<float> avg_cylinder_r;
+	long long reserved = params.median_estimator_sequential ? min((long long) params.median_min_samples, sampler.remaining) : sampler.remaining; // (the sequential estimator usually stops long before all combinations are drawn)
+	avg_cylinder_x.reserve(reserved);
+	avg_cylinder_y.reserve(reserved);
+	avg_cylinder_r.reserve(reserved);
+	long long next_check = params.median_min_samples;
+	// ********* Find if there is a circle passing through the projections of the 3 selected points points onto XY-plane (for a batch of random combinations at a time) ******
+	CircleBatch batch;
+	int index1[circle_batch_size], index2[circle_batch_size], index3[circle_batch_size];
+	result.num_triples = 0;
+	while ((batch.size = sampler.next_batch(index1, index2, index3, circle_batch_size)) > 0) {
+		result.num_triples += batch.size;
+		for (int yb = 0; yb < batch.size; yb++) {
+			int p0 = reduced_cluster[index1[yb]], p1 = reduced_cluster[index2[yb]], p2 = reduced_cluster[index3[yb]];
+			batch.x0[yb] = cloud.x[p0];
+			batch.y0[yb] = cloud.y[p0];
+			batch.x1[yb] = cloud.x[p1];
+			batch.y1[yb] = cloud.y[p1];
+			batch.x2[yb] = cloud.x[p2];
+			batch.y2[yb] = cloud.y[p2];
+		}
+		fit_circles(batch);
+		for (int yb = 0; yb < batch.size; yb++) {
+			if (batch.valid[yb]) {
+				avg_cylinder_x.push_back(batch.s[yb]);
+				avg_cylinder_y.push_back(batch.t[yb]);
+				avg_cylinder_r.push_back(batch.r[yb]);
+			}
+		}
+		if (params.median_estimator_sequential && (avg_cylinder_r.size() >= next_check)) {
+			if (median_cylinder_converged(avg_cylinder_x, avg_cylinder_y, avg_cylinder_r, params)) {
+				result.converged = true;
+				break;
+			}
+			next_check *= 2;
+		}
+	}
+	// ******************************************************************************************
+	float median_cylinder_x,median_cylinder_y,median_cylinder_r;
+	// cout << "Number of cylinders in the reduced_cluster: " << avg_cylinder_x.size() << endl;
+	if (avg_cylinder_r.size() == 0) { // no circle passes through any combination (all points are collinear), so the radius is infinite
+		median_cylinder_x = cloud.x[cluster[0]];
+		median_cylinder_y = cloud.y[cluster[0]];
+		median_cylinder_r = 100000.0;
+	} else {
+		median_cylinder_x = median_of(avg_cylinder_x);
+		median_cylinder_y = median_of(avg_cylinder_y);
+		median_cylinder_r = median_of(avg_cylinder_r);
+	}
+
+	result.num_points = cluster.size();
+	result.num_circles = avg_cylinder_r.size();
+	result.min_z = min_z;
+	result.max_z = max_z;
+	// time(&end_med_rad);
+	// double time_taken = double(end_med_rad - start_med_rad);
+	// cout << "Time taken for cluster-"<< curr_cluster_num <<  " is : " << time_taken << endl;
+	result.x = median_cylinder_x;
+	result.y = median_cylinder_y;
+	result.r = median_cylinder_r;
+}
+
+// ************************************ Work-stealing pool of threads ************************************
+
+thread_local TaskPool* current_pool = NULL; // pool (& queue) of the worker the calling thread is
+thread_local int current_queue = -1;
+
+TaskPool::TaskPool(int num_threads) {
+	if (num_threads <= 0) {num_threads = max(1u, thread::hardware_concurrency());}
+	created = chrono::steady_clock::now();
+	for (int q=0; q<num_threads; q++) { // num_threads-1 workers & the queue of tasks submitted from outside
+		queues.emplace_back(new Queue());
+	}
+	for (int w=0; w<num_threads-1; w++) {
+		workers.emplace_back(&TaskPool::worker_loop, this, w);
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		lock_guard<mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (int w=0; w<workers.size(); w++) {
+		workers[w].join();
+	}
+}
+
+int TaskPool::own_queue() {
+	return (current_pool == this) ? current_queue : queues.size()-1;
+}
+
+void TaskPool::submit(function<void()> task, TaskGroup* group) {
+	if (group != NULL) {
+		group->pending++;
+		group->queued++;
+	}
+	Queue& q = *queues[own_queue()];
+	{
+		lock_guard<mutex> lock(q.mutex);
+		q.tasks.push_back({move(task), group});
+	}
+	queued++;
+	{
+		lock_guard<mutex> lock(sleep_mutex); // (so that a thread which just found no task can't miss the wake-up)
+	}
+	wake.notify_all(); // (threads waiting for a group of other tasks sleep on `wake` too, so notify_one could wake one of them instead of an idle worker)
+}
+
+bool TaskPool::run_one(int self, TaskGroup* only) {
+	// Runs the newest task of the thread's own queue, else the oldest task of the other queues (only tasks of group `only`, if given).
+	// Returns false if there was no task.
+	if ((only != NULL) ? (only->queued == 0) : (queued == 0)) {return false;}
+	Task task;
+	bool found = false;
+	for (int k=0; !found && (k<queues.size()); k++) { // own queue 1st, then the others (a thread outside the pool owns the queue of outside tasks)
+		int q = (self+k)%queues.size();
+		bool newest_first = (k == 0) && (self < workers.size());
+		lock_guard<mutex> lock(queues[q]->mutex);
+		deque<Task>& tasks = queues[q]->tasks;
+		for (int i=0; i<tasks.size(); i++) {
+			int t = newest_first ? tasks.size()-1-i : i;
+			if ((only == NULL) || (tasks[t].group == only)) {
+				task = move(tasks[t]);
+				tasks.erase(tasks.begin()+t);
+				found = true;
+				break;
+			}
+		}
+	}
+	if (!found) {return false;}
+	queued--;
+	if (task.group != NULL) {task.group->queued--;}
+	task.run();
+	if ((task.group != NULL) && (--task.group->pending == 0)) {
+		lock_guard<mutex> lock(sleep_mutex);
+		wake.notify_all(); // the thread waiting for the group may be asleep
+	}
+	return true;
+}
+
+void TaskPool::worker_loop(int self) {
+	current_pool = this;
+	current_queue = self;
+	while (true) {
+		if (run_one(self)) {continue;}
+		unique_lock<mutex> lock(sleep_mutex);
+		if (stopping) {break;}
+		auto start = chrono::steady_clock::now();
+		wake.wait(lock, [&]() {return (queued > 0) || stopping;});
+		idle_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-start).count();
+		if (stopping) {break;}
+	}
+}
+
+void TaskPool::wait(TaskGroup& group) {
+	int self = own_queue();
+	while (group.pending > 0) {
+		if (run_one(self, &group)) {continue;}
+		unique_lock<mutex> lock(sleep_mutex);
+		auto start = chrono::steady_clock::now();
+		wake.wait(lock, [&]() {return (group.queued > 0) || (group.pending == 0);});
+		idle_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-start).count();
+	}
+}
+
+double TaskPool::idle_fraction() const {
+	double elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-created).count();
+	return (elapsed > 0) ? idle_ns/(elapsed*size()) : 0;
+}
+
+void run_tasks(const vector<int>& order, int num_threads, TaskPool* task_pool, const function<void(int)>& task) {
+	// Runs task(i) for every i in `order` (started in that order): as tasks of `task_pool` if given, else on a pool of `num_threads` threads
+	// (0: all cores) of its own, where each thread repeatedly picks the next task which isn't taken yet.
+	if (task_pool != NULL) {
+		TaskGroup group;
+		for (int k=0; k<order.size(); k++) {
+			int i = order[k];
+			task_pool->submit([&task, i]() {task(i);}, &group);
+		}
+		task_pool->wait(group);
+		return;
+	}
+	int threads = num_threads;
+	if (threads <= 0) {threads = max(1u, thread::hardware_concurrency());}
+	atomic<int> next(0);
+	auto worker = [&]() {
+		for (int k = next++; k < order.size(); k = next++) {
+			task(order[k]);
+		}
+	};
+	vector<thread> pool;
+	for (int t=1; t<min(threads, (int) order.size()); t++) {
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (int t=0; t<pool.size(); t++) {
+		pool[t].join();
+	}
+}
+
+void find_median_radius_of_clusters (PointCloud& cloud, vector<IndexSpan>& clusters, vector<MedianCylinder>& results, const SegmenterParams& params, const vector<int>* cluster_nums, TaskPool* task_pool) {
+	// Finds the median cylinders of all clusters on a pool of `params.num_threads` threads (or as tasks of `task_pool`, if given).
+	// Since results are stored per cluster, the output doesn't depend on the number of threads or on the order in which the clusters get processed.
+	// The random combinations of clusters[i] are seeded with (*cluster_nums)[i] if given (its number in the ClusterSet), else with i.
+	// Largest clusters are started first (& with a TaskPool, idle threads steal them first), so that a big cluster doesn't start last.
+	results.assign(clusters.size(), MedianCylinder());
+	vector<int> order(clusters.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&](int a, int b) {return clusters[a].size() > clusters[b].size();});
+	run_tasks(order, params.num_threads, task_pool, [&](int i) {
+		find_median_radius(cloud, clusters[i], (cluster_nums != NULL) ? (*cluster_nums)[i] : i, params, results[i]);
+	});
+}
+
+int count_points_inside_median_cylinder (PointCloud& cloud, IndexSpan cluster, const MedianCylinder& cylinder) {
+	int enclosed_points = 0;
+	for (int f1 = 0; f1<cluster.size(); f1++) {
+		if (distance_bw_points_projection(cylinder.x, cylinder.y, cloud.x[cluster[f1]], cloud.y[cluster[f1]]) <= cylinder.r) {
+			enclosed_points++;
+		}
+	}
+	return enclosed_points;
+}
+
+int check_if_cluster_resides_inside_median_cylinder (PointCloud& cloud, IndexSpan cluster, const MedianCylinder& cylinder, float cluster_enclosing_threshold) {
+	int total_points = cluster.size();
+	// cluster_enclosing_threshold = 0.98;
+	int enclosed_points = count_points_inside_median_cylinder(cloud, cluster, cylinder);
+	if (enclosed_points >= (total_points*cluster_enclosing_threshold)) {
+		return 1;
+	} else {return 0;}
+}
+
+void symmetric_eigenvalues(double a[3][3], double l[3]) {
+	// Eigenvalues (l[0] >= l[1] >= l[2]) of a symmetric 3x3 matrix, in closed form (trigonometric solution of the characteristic cubic).
+	double p1 = a[0][1]*a[0][1]+a[0][2]*a[0][2]+a[1][2]*a[1][2];
+	double q = (a[0][0]+a[1][1]+a[2][2])/3;
+	double p2 = (a[0][0]-q)*(a[0][0]-q)+(a[1][1]-q)*(a[1][1]-q)+(a[2][2]-q)*(a[2][2]-q)+2*p1;
+	double p = sqrt(p2/6);
+	if (p == 0) { // a multiple of the identity
+		l[0] = l[1] = l[2] = q;
+		return;
+	}
+	double b[3][3];
+	for (int i=0; i<3; i++) {
+		for (int j=0; j<3; j++) {b[i][j] = (a[i][j]-((i == j) ? q : 0))/p;}
+	}
+	double det = b[0][0]*(b[1][1]*b[2][2]-b[1][2]*b[2][1])-b[0][1]*(b[1][0]*b[2][2]-b[1][2]*b[2][0])+b[0][2]*(b[1][0]*b[2][1]-b[1][1]*b[2][0]);
+	double phi = acos(min(1.0, max(-1.0, det/2)))/3;
+	l[0] = q+2*p*cos(phi);
+	l[2] = q+2*p*cos(phi+2*M_PI/3);
+	l[1] = 3*q-l[0]-l[2];
+}
+
+void find_cluster_shape (PointCloud& cloud, IndexSpan cluster, ClusterShape& shape) {
+	// 3 passes over the points: mean, covariance (& range of z), extents along the principal axes of the XY-projection.
+	int n = cluster.size();
+	double mx = 0, my = 0, mz = 0;
+	for (int i=0; i<n; i++) {
+		mx += cloud.x[cluster[i]];
+		my += cloud.y[cluster[i]];
+		mz += cloud.z[cluster[i]];
+	}
+	mx /= n;
+	my /= n;
+	mz /= n;
+	double c[3][3] = {};
+	float min_z = 1000, max_z = -1000;
+	for (int i=0; i<n; i++) {
+		double d[3] = {cloud.x[cluster[i]]-mx, cloud.y[cluster[i]]-my, cloud.z[cluster[i]]-mz};
+		for (int j=0; j<3; j++) {
+			for (int k=j; k<3; k++) {c[j][k] += d[j]*d[k];}
+		}
+		min_z = min(min_z, cloud.z[cluster[i]]);
+		max_z = max(max_z, cloud.z[cluster[i]]);
+	}
+	for (int j=0; j<3; j++) {
+		for (int k=j; k<3; k++) {
+			c[j][k] /= n;
+			c[k][j] = c[j][k];
+		}
+	}
+	double l[3];
+	symmetric_eigenvalues(c, l);
+	shape.linearity = (l[0] > 0) ? (l[0]-l[1])/l[0] : 0;
+	shape.planarity = (l[0] > 0) ? (l[1]-max(l[2], 0.0))/l[0] : 0;
+	shape.height = max_z-min_z;
+	double angle = 0.5*atan2(2*c[0][1], c[0][0]-c[1][1]); // direction of the principal axis of the XY-projection
+	double ux = cos(angle), uy = sin(angle);
+	double min_u = 1e30, max_u = -1e30, min_v = 1e30, max_v = -1e30;
+	for (int i=0; i<n; i++) {
+		double dx = cloud.x[cluster[i]]-mx, dy = cloud.y[cluster[i]]-my;
+		double u = dx*ux+dy*uy, v = dy*ux-dx*uy;
+		min_u = min(min_u, u);
+		max_u = max(max_u, u);
+		min_v = min(min_v, v);
+		max_v = max(max_v, v);
+	}
+	shape.length = max(max_u-min_u, max_v-min_v);
+	shape.width = min(max_u-min_u, max_v-min_v);
+}
+
+// ************************************ Segmenter ************************************
+
+string Metrics::to_json() const {
+	const char* stage_names[num_stages] = {"parse", "preprocess", "cluster_growth", "ground_removal", "size_filter", "median_radius", "enclosure_filter", "output"};
+	ostringstream json;
+	json << "{\n  \"stages_ns\": {";
+	for (int i=0; i<num_stages; i++) {
+		json << (i ? ", " : "") << "\"" << stage_names[i] << "\": " << stage_ns[i];
+	}
+	json << "},\n  \"counters\": {";
+	json << "\"points\": " << points;
+	json << ", \"ground_points_removed\": " << ground_points_removed;
+	json << ", \"points_clustered\": " << points_clustered;
+	json << ", \"neighbor_distance_evals\": " << neighbor_distance_evals;
+	json << ", \"points_erased\": " << points_erased;
+	json << ", \"clusters_formed\": " << clusters_formed;
+	json << ", \"clusters_discarded_while_growing\": " << clusters_discarded_while_growing;
+	json << ", \"clusters_stopped_oversize\": " << clusters_stopped_oversize;
+	json << ", \"points_flood_filled\": " << points_flood_filled;
+	json << ", \"triples_sampled\": " << triples_sampled;
+	json << ", \"degenerate_triples\": " << degenerate_triples;
+	json << ", \"clusters_rejected_by_size\": " << clusters_rejected_by_size;
+	json << ", \"clusters_rejected_by_radius\": " << clusters_rejected_by_radius;
+	json << ", \"clusters_rejected_by_enclosure\": " << clusters_rejected_by_enclosure;
+	json << ", \"clusters_rejected_by_aspect\": " << clusters_rejected_by_aspect;
+	json << ", \"clusters_rejected_by_planarity\": " << clusters_rejected_by_planarity;
+	json << ", \"clusters_rejected_by_linearity\": " << clusters_rejected_by_linearity;
+	json << ", \"clusters_rejected_by_flatness\": " << clusters_rejected_by_flatness;
+	json << ", \"trees\": " << trees;
+	json << "}\n}\n";
+	return json.str();
+}
+
+void Metrics::add(const Metrics& other) {
+	for (int i=0; i<num_stages; i++) {stage_ns[i] += other.stage_ns[i];}
+	points += other.points;
+	ground_points_removed += other.ground_points_removed;
+	points_clustered += other.points_clustered;
+	neighbor_distance_evals += other.neighbor_distance_evals;
+	points_erased += other.points_erased;
+	clusters_formed += other.clusters_formed;
+	clusters_discarded_while_growing += other.clusters_discarded_while_growing;
+	clusters_stopped_oversize += other.clusters_stopped_oversize;
+	points_flood_filled += other.points_flood_filled;
+	triples_sampled += other.triples_sampled;
+	degenerate_triples += other.degenerate_triples;
+	clusters_rejected_by_size += other.clusters_rejected_by_size;
+	clusters_rejected_by_radius += other.clusters_rejected_by_radius;
+	clusters_rejected_by_enclosure += other.clusters_rejected_by_enclosure;
+	clusters_rejected_by_aspect += other.clusters_rejected_by_aspect;
+	clusters_rejected_by_planarity += other.clusters_rejected_by_planarity;
+	clusters_rejected_by_linearity += other.clusters_rejected_by_linearity;
+	clusters_rejected_by_flatness += other.clusters_rejected_by_flatness;
+	trees += other.trees;
+}
+
+void Segmenter::form_clusters(PointCloud& coordinate, ClusterSet& clusters) {
+	// Each cluster is seeded at the 1st point (in the order of the points) which isn't claimed yet & grown step by step:
+	// a step adds all the (unclaimed) neighbors (within `proximity_threshold`) of the points added in the previous step.
+	// After accumulating 200 points, check variability of z-coordinates in cluster
+	// Don't abruptly stop expanding the cluster once its size reaches 200. Allow it to continue the current growth step & then stop to check whether there is variability in z-coordinates of the points in cluster
+	// after every step (of adding 200 points), remove points whose z-coordinates are almost similar & continue expanding same cluster.
+	// First check height(variability in z-coordinates) & then check if the obtained tall cluster is circular in XY-Plane.
+	if ((params.downsample_voxel > 0) || (params.ground_cell_size > 0)) {
+		form_clusters_preprocessed(coordinate, clusters);
+		return;
+	}
+	if (params.cluster_tile_size > 0) {
+		form_clusters_tiled(coordinate, clusters);
+		return;
+	}
+	float proximity_threshold = params.proximity_threshold;
+	int count1 = 0;
+	int flag1 = 0;
+	float cluster_z_range_threshold=(params.cluster_z_range_fraction)*(2*proximity_threshold);//hyper-parameter
+	float range,max_z,min_z;
+	int curr_set_idx, next_set_idx, curr_count = 0, num_steps=0;
+	int trace_level = (trace != NULL) ? params.trace_level : trace_off;
+	StageTimer timer(metrics, Metrics::stage_cluster_growth);
+	long long erased = 0;
+	metrics.points += coordinate.size();
+	metrics.points_clustered += coordinate.size();
+	clusters.members.clear();
+	clusters.bounds.clear();
+	// Instead of scanning all the remaining points of the map for neighbors of every cluster point, only the 27 grid cells around the cluster point are scanned.
+	// A point claimed by a cluster is removed from the grid (there is no need to check proximity of one cluster point to another cluster point).
+	VoxelGrid grid;
+	grid.build(coordinate, proximity_threshold);
+	vector<int> ngbrs;
+	vector<int> curr_cluster; // indices (into `coordinate`) of the points of the cluster being grown
+	ClusterStats curr_stats; // min & max of z (& histogram of z) of the cluster being grown
+	vector<int> removed_pts; // points removed from the cluster by the latest ground removal (only tracked for trace_steps)
+	int traced_size = 0; // (trace_steps) points of curr_cluster[0..traced_size) are already in the trace
+	bool reaches_border = false; // (in a tile) the cluster has points near the border of the tile
+	for (int seed=0; seed<coordinate.size(); seed++) { // each cluster is seeded at the 1st point (in the order of the wrl file) which isn't claimed yet
+		if (!grid.contains(seed)) {continue;}
+		if (params.verbose) {cout << "********************* Starting cluster-" << count1+1 << endl;}
+		curr_cluster.assign(1, seed);
+		curr_stats.clear();
+		curr_stats.add(coordinate.z[seed]);
+		grid.remove(seed);
+		reaches_border = (near_border != NULL) && (*near_border)[seed];
+		curr_set_idx = 0;//each set corresponds to one iteration of adding points to cluster
+		next_set_idx = 1;
+		num_steps=0;
+		curr_count=0;
+		traced_size=0;
+		for (int dl=0; dl<curr_cluster.size(); dl++){
+			if (dl>=next_set_idx) {
+				curr_set_idx = next_set_idx;
+				next_set_idx = curr_set_idx+curr_count;
+				curr_count = 0;
+			}
+			flag1 = 0;
+			ngbrs.clear();
+			grid.radius_query(curr_cluster[dl], coordinate, proximity_threshold, ngbrs);
+			sort(ngbrs.begin(), ngbrs.end()); // add the neighbors in the order of the wrl file (same order in which a scan over all points would find them)
+			for (int rl=0; rl<ngbrs.size(); rl++){
+				curr_cluster.push_back(ngbrs[rl]);
+				curr_stats.add(coordinate.z[ngbrs[rl]]);
+				grid.remove(ngbrs[rl]);
+				if (near_border != NULL) {reaches_border = reaches_border || (*near_border)[ngbrs[rl]];}
+				if ((dl>= curr_set_idx) && (dl< next_set_idx)) {// just keeping the if-condition although its redundant.
+					curr_count++;
+				}
+			}
+			max_z = curr_stats.max_z;
+			min_z = curr_stats.min_z;
+			range = max_z-min_z;
+			if (range < cluster_z_range_threshold) { 
+				// if there is no sufficient variation in z-coordinates of the points in cluster, it means that the current cluster is a part of a horizontal surface (like road) & can't be a part of tree.
+				//  & hence discard the current cluster.
+				// (In a tile, a cluster which reached the border of the tile is deferred instead: its range of z is tested once it's merged across the border.)
+				count1--;
+				flag1=1;
+				if ((deferred != NULL) && reaches_border) {
+					flag1=2;
+				} else {
+					metrics.clusters_discarded_while_growing++;
+				}
+				break;
+			}
+			if (dl==(next_set_idx-1)) { // if one step of growth is completed
+				// Allow the cluster to grow in all directions for one step. & then check if the cluster has any points corresponding to ground.
+				// If the cluster has points corresponding to both ground & tree, remove the ground points(so that cluster won't grow in ground direction in next step) & continue growing only in tree direction.
+				num_steps++;
+				if (params.verbose) {cout << curr_cluster.size() << " | " ;}
+				erased += curr_cluster.size();
+				if (trace_level == trace_steps) {
+					trace->add({seed, count1+1, num_steps, 0, (int)curr_cluster.size()-traced_size, 0}, coordinate, curr_cluster.data()+traced_size, NULL);
+					removed_pts.clear();
+					StageTimer ground_timer(metrics, Metrics::stage_ground_removal);
+					remove_ground_pts_from_cluster(coordinate, curr_cluster, curr_stats, params.ground_z_band_fraction, params.ground_points_fraction, &removed_pts);
+				} else {
+					StageTimer ground_timer(metrics, Metrics::stage_ground_removal);
+					remove_ground_pts_from_cluster(coordinate, curr_cluster, curr_stats, params.ground_z_band_fraction, params.ground_points_fraction);
+				}
+				if (trace_level == trace_steps) {
+					trace->add({seed, count1+1, num_steps, 1, 0, (int)removed_pts.size()}, coordinate, NULL, removed_pts.data());
+					traced_size = curr_cluster.size();
+				}
+				erased -= curr_cluster.size();
+				if (params.verbose) {cout << curr_cluster.size() << " || ";}
+				if ((params.growth_size_limit > 0) && (curr_cluster.size() > params.growth_size_limit)) {
+					// Far too large to be a tree (facade, curb, ...): stop growing it step by step (with ground removal after every step), only to discard it in the size filter.
+					// The rest of its connected component is claimed by a plain flood fill (no ground removal, ClusterStats or trace), so that the points it didn't reach yet can't seed clusters of their own.
+					// (So a tree connected to it, e.g. through the ground, is rejected with it.)
+					count1--;
+					flag1=1;
+					metrics.clusters_stopped_oversize++;
+					int reached = curr_cluster.size();
+					for (int fl=dl+1; fl<curr_cluster.size(); fl++) {
+						ngbrs.clear();
+						grid.radius_query(curr_cluster[fl], coordinate, proximity_threshold, ngbrs);
+						for (int rl=0; rl<ngbrs.size(); rl++) {
+							curr_cluster.push_back(ngbrs[rl]);
+							grid.remove(ngbrs[rl]);
+						}
+					}
+					metrics.points_flood_filled += curr_cluster.size()-reached;
+					if (stopped != NULL) {
+						stopped->bounds.push_back({(int)stopped->members.size(), (int)curr_cluster.size()});
+						stopped->members.insert(stopped->members.end(), curr_cluster.begin(), curr_cluster.end());
+					}
+					break;
+				}
+			}
+		}
+		if (flag1 == 1) { // rejected while it was grown: its points (& those of its flood fill) are labeled at once (they're already claimed, so they're never scanned or seeded again)
+			for (int ml=0; ml<curr_cluster.size(); ml++) {coordinate.label[curr_cluster[ml]] = label_rejected;}
+		}
+		if (flag1 == 2) { // deferred (its points stay claimed)
+			deferred->bounds.push_back({(int)deferred->members.size(), (int)curr_cluster.size()});
+			deferred->members.insert(deferred->members.end(), curr_cluster.begin(), curr_cluster.end());
+		}
+		if (flag1 == 0) {
+			clusters.bounds.push_back({(int)clusters.members.size(), (int)curr_cluster.size()});
+			for (int ml=0; ml<curr_cluster.size(); ml++) {
+				clusters.members.push_back(curr_cluster[ml]);
+				coordinate.label[curr_cluster[ml]] = count1+1;
+			}
+			if (params.verbose) {cout << "Number of points in current cluster = " << curr_cluster.size() << endl;}
+			if (trace_level == trace_final) {
+				trace->add({seed, count1+1, num_steps, 2, (int)curr_cluster.size(), 0}, coordinate, curr_cluster.data(), NULL);
+			}
+		}
+		count1++;
+	}
+	metrics.clusters_formed += clusters.size();
+	metrics.points_erased += erased;
+	metrics.neighbor_distance_evals += grid.distance_evals;
+}
+
+// Union-find over the pieces of clusters grown in different tiles, which several threads can unite concurrently (without locks).
+// The root of a set is its smallest element, so the sets found don't depend on the order of the unions.
+struct ConcurrentUnionFind {
+	vector<atomic<int>> parent;
+
+	ConcurrentUnionFind(int n) : parent(n) {
+		for (int i=0; i<n; i++) {parent[i] = i;}
+	}
+
+	int find(int i) {
+		while (true) {
+			int p = parent[i];
+			if (p == i) {return i;}
+			int gp = parent[p];
+			if (gp != p) {parent[i].compare_exchange_weak(p, gp);} // path halving (skipped if another thread changed parent[i] meanwhile)
+			i = gp;
+		}
+	}
+
+	void unite(int a, int b) {
+		while (true) {
+			a = find(a);
+			b = find(b);
+			if (a == b) {return;}
+			if (a > b) {swap(a, b);}
+			int expected = b;
+			if (parent[b].compare_exchange_strong(expected, a)) {return;} // b was still a root: link it under the smaller root (else retry)
+		}
+	}
+};
+
+void Segmenter::form_clusters_tiled(PointCloud& coordinate, ClusterSet& clusters) {
+	// The map is split into square tiles (in XY) of size `cluster_tile_size` (at least 2*proximity_threshold) & the clusters of each tile are
+	// grown concurrently, exactly as form_clusters grows them (z-range rejection & ground removal included), but only with the points of the tile.
+	// A cluster which reaches the border of its tile is cut there: the rest of it is grown as cluster(s) of the neighboring tile(s).
+	// So, the pieces of clusters which have points within `proximity_threshold` of each other across a border are merged (with a concurrent
+	// union-find over the points near the borders of tiles). Clusters are numbered in the order of their seeds (smallest index of a point which
+	// seeded one of their pieces), so the output doesn't depend on the number of threads.
+	// A cluster stopped at the size limit in a tile rejects the pieces it meets across the borders too (in form_clusters, the flood fill would
+	// have claimed them). A piece which reached the border of its tile isn't discarded by the test of its range of z in the tile: it's deferred to the
+	// merged cluster, which is checked again as a whole (size limit & range of z). Differences from form_clusters remain, due to the order of seeds:
+	// a cluster is cut at the borders of tiles while it's grown, so a piece has its ground removed on its own & points claimed by a cluster in one
+	// tile aren't claimed across the border. So near borders, the ground at the bases of clusters (& trees) may differ a little from that of
+	// sequential growth (see `treeseg_bench --check`).
+	// Only the final clusters are traced & progress isn't printed.
+	float proximity_threshold = params.proximity_threshold;
+	float tile_size = max(params.cluster_tile_size, 2*proximity_threshold);
+	StageTimer timer(metrics, Metrics::stage_cluster_growth);
+	metrics.points += coordinate.size();
+	clusters.members.clear();
+	clusters.bounds.clear();
+
+	// points of each tile, in the order of the points
+	unordered_map<long long, int> tile_of_key;
+	vector<vector<int>> tile_points;
+	vector<int> point_tile(coordinate.size());
+	for (int p=0; p<coordinate.size(); p++) {
+		long long tx = (long long) floor(coordinate.x[p]/tile_size), ty = (long long) floor(coordinate.y[p]/tile_size);
+		auto it = tile_of_key.emplace((tx << 32) ^ (ty & 0xFFFFFFFFLL), tile_points.size()).first;
+		if (it->second == tile_points.size()) {tile_points.emplace_back();}
+		tile_points[it->second].push_back(p);
+		point_tile[p] = it->second;
+	}
+
+	// clusters of each tile (largest tiles are started first), the clusters stopped at the size limit in each tile (with their flood fills) &
+	// the clusters deferred in each tile (which failed the test of their range of z after reaching the border of the tile)
+	vector<ClusterSet> tile_clusters(tile_points.size()), tile_stopped(tile_points.size()), tile_deferred(tile_points.size());
+	auto near_border = [&](int p) { // point p is within proximity_threshold of the border of its tile
+		float fx = coordinate.x[p]/tile_size, fy = coordinate.y[p]/tile_size;
+		float dx = min(fx-floor(fx), floor(fx)+1-fx)*tile_size, dy = min(fy-floor(fy), floor(fy)+1-fy)*tile_size; // distances to the borders
+		return (dx <= proximity_threshold) || (dy <= proximity_threshold);
+	};
+	vector<int> order(tile_points.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&](int a, int b) {return tile_points[a].size() > tile_points[b].size();});
+	mutex metrics_lock;
+	run_tasks(order, params.num_threads, pool, [&](int t) {
+		PointCloud tile;
+		vector<char> tile_near_border(tile_points[t].size());
+		tile.reserve(tile_points[t].size());
+		for (int p : tile_points[t]) {
+			tile_near_border[tile.size()] = near_border(p);
+			tile.push_back(coordinate.x[p], coordinate.y[p], coordinate.z[p], p);
+		}
+		Segmenter segmenter(params);
+		segmenter.params.cluster_tile_size = 0;
+		segmenter.params.verbose = 0;
+		segmenter.metrics.enabled = metrics.enabled;
+		segmenter.stopped = &tile_stopped[t];
+		segmenter.near_border = &tile_near_border;
+		segmenter.deferred = &tile_deferred[t];
+		segmenter.form_clusters(tile, tile_clusters[t]);
+		for (ClusterSet* set : {&tile_clusters[t], &tile_stopped[t], &tile_deferred[t]}) { // indices into the tile -> indices into the map
+			for (int i=0; i<set->members.size(); i++) {set->members[i] = tile.index[set->members[i]];}
+		}
+		for (int i=0; i<tile.size(); i++) { // points of the clusters rejected while they were grown (each point is in one tile only)
+			if (tile.label[i] == label_rejected) {coordinate.label[tile.index[i]] = label_rejected;}
+		}
+		segmenter.metrics.points = 0;
+		segmenter.metrics.clusters_formed = 0;
+		segmenter.metrics.stage_ns[Metrics::stage_cluster_growth] = 0; // (time of the whole tiled growth is measured by `timer`)
+		lock_guard<mutex> guard(metrics_lock);
+		metrics.add(segmenter.metrics);
+	});
+
+	// pieces (clusters, stopped clusters & deferred clusters of the tiles) & the points of the pieces which are within proximity_threshold of the border of their tile
+	const char kind_cluster = 0, kind_stopped = 1, kind_deferred = 2;
+	vector<IndexSpan> pieces;
+	vector<int> piece_tile;
+	vector<char> piece_kind;
+	PointCloud border; // index: index of the point in the map, label: its piece
+	for (int t=0; t<tile_points.size(); t++) {
+		for (char kind : {kind_cluster, kind_stopped, kind_deferred}) {
+			ClusterSet& set = (kind == kind_cluster) ? tile_clusters[t] : ((kind == kind_stopped) ? tile_stopped[t] : tile_deferred[t]);
+			for (int c=0; c<set.size(); c++) {
+				IndexSpan piece = set[c];
+				for (int i=0; i<piece.size(); i++) {
+					int p = piece[i];
+					if (near_border(p)) {border.push_back(coordinate.x[p], coordinate.y[p], coordinate.z[p], p, pieces.size());}
+				}
+				pieces.push_back(piece);
+				piece_tile.push_back(t);
+				piece_kind.push_back(kind);
+			}
+		}
+	}
+
+	// merge pieces of different tiles which have neighboring points (concurrently, a chunk of border points per task)
+	// A deferred piece isn't merged with others by the union-find: it joins the cluster it has most neighboring points with (after the union-find),
+	// so that it can't join 2 clusters together, & deferred pieces don't join each other (else e.g. patches of ground along a border would make a
+	// chain joining all the clusters on the border), except next to a stopped cluster.
+	ConcurrentUnionFind sets(pieces.size());
+	VoxelGrid grid;
+	grid.build(border, proximity_threshold);
+	const int chunk = 4096;
+	vector<int> chunks((border.size()+chunk-1)/chunk);
+	iota(chunks.begin(), chunks.end(), 0);
+	vector<vector<pair<int,int>>> chunk_links(chunks.size()); // (deferred piece, piece) of neighboring points, found by each chunk
+	atomic<long long> distance_evals(0);
+	run_tasks(chunks, params.num_threads, pool, [&](int k) {
+		vector<int> ngbrs;
+		long long evals = 0;
+		for (int i=k*chunk; i<min((k+1)*chunk, border.size()); i++) {
+			ngbrs.clear();
+			evals += grid.find_neighbors(i, border, proximity_threshold, ngbrs);
+			int a = border.label[i];
+			for (int j : ngbrs) {
+				int b = border.label[j];
+				if ((j < i) || (piece_tile[a] == piece_tile[b])) {continue;}
+				if (piece_kind[a] == kind_deferred) {chunk_links[k].push_back({a, b});}
+				if (piece_kind[b] == kind_deferred) {chunk_links[k].push_back({b, a});}
+				if ((piece_kind[a] != kind_deferred) && (piece_kind[b] != kind_deferred)) {sets.unite(a, b);}
+			}
+		}
+		distance_evals += evals;
+	});
+	metrics.neighbor_distance_evals += distance_evals;
+	vector<int> joins(pieces.size(), -1); // root of the cluster each deferred piece joins (-1: none)
+	{
+		// The flood fill would have claimed a deferred piece next to a stopped cluster & all the clusters (& deferred pieces) it's next to: they're
+		// merged with the stopped cluster (repeatedly, as this makes more clusters stopped).
+		vector<char> stopped_root(pieces.size(), 0);
+		for (bool changed = true; changed; ) {
+			changed = false;
+			fill(stopped_root.begin(), stopped_root.end(), 0);
+			for (int piece=0; piece<pieces.size(); piece++) {
+				if (piece_kind[piece] == kind_stopped) {stopped_root[sets.find(piece)] = 1;}
+			}
+			vector<char> next_to_stopped(pieces.size(), 0);
+			for (auto& chunk_link : chunk_links) {
+				for (auto& link : chunk_link) {next_to_stopped[link.first] = next_to_stopped[link.first] || stopped_root[sets.find(link.second)];}
+			}
+			for (auto& chunk_link : chunk_links) {
+				for (auto& link : chunk_link) {
+					if (next_to_stopped[link.first] && (sets.find(link.first) != sets.find(link.second))) {
+						sets.unite(link.first, link.second);
+						changed = true;
+					}
+				}
+			}
+		}
+		map<pair<int,int>, int> links; // (deferred piece, root) -> number of neighboring points
+		for (auto& chunk_link : chunk_links) {
+			for (auto& link : chunk_link) {
+				if ((piece_kind[link.second] != kind_deferred) || stopped_root[sets.find(link.second)]) {links[{link.first, sets.find(link.second)}]++;}
+			}
+		}
+		int best = 0;
+		for (auto& link : links) { // (for each deferred piece, roots in increasing order: ties are joined to the smallest root)
+			if ((joins[link.first.first] == -1) || (link.second > best)) {
+				joins[link.first.first] = link.first.second;
+				best = link.second;
+			}
+		}
+	}
+
+	// clusters: merged pieces, in the order of their seeds (the 1st point of each piece, which is its seed unless ground removal removed it)
+	vector<vector<int>> merged(pieces.size()); // pieces of each root, in the order of their seeds (deferred pieces after the others)
+	vector<int> piece_order(pieces.size());
+	iota(piece_order.begin(), piece_order.end(), 0);
+	sort(piece_order.begin(), piece_order.end(), [&](int a, int b) {return pieces[a][0] < pieces[b][0];});
+	vector<int> roots; // in the order of the seeds of their 1st pieces
+	for (int k=0; k<piece_order.size(); k++) {
+		int piece = piece_order[k];
+		if (piece_kind[piece] == kind_deferred) {continue;}
+		int root = sets.find(piece);
+		if (merged[root].empty()) {roots.push_back(root);}
+		merged[root].push_back(piece);
+	}
+	for (int k=0; k<piece_order.size(); k++) {
+		int piece = piece_order[k];
+		if (piece_kind[piece] != kind_deferred) {continue;}
+		if (joins[piece] != -1) {
+			merged[joins[piece]].push_back(piece);
+		} else { // next to no cluster across the border: discarded, as it would have been in the tile
+			metrics.clusters_discarded_while_growing++;
+			for (int i=0; i<pieces[piece].size(); i++) {coordinate.label[pieces[piece][i]] = label_rejected;}
+		}
+	}
+	// A cluster merged from several pieces is checked again as a whole, by the size limit & the range of z (each piece was only checked on its own,
+	// so e.g. a cluster cut into 2 pieces under the size limit would pass it). Ground removal isn't run again: ground was removed from each piece as
+	// it was grown (removing it again from the whole cluster also removes the bases of trunks, & costs accuracy on the 17 maps). Only the points
+	// of a deferred piece which aren't below the other pieces are added to the cluster (the others are mostly ground, which the pieces grown
+	// across the border had removed or never reached).
+	float cluster_z_range_threshold = params.cluster_z_range_fraction*(2*proximity_threshold);
+	vector<int> whole;
+	ClusterStats whole_stats;
+	for (int r=0; r<roots.size(); r++) {
+		bool meets_stopped = false; // (a stopped piece's points are already labeled label_rejected)
+		for (int piece : merged[roots[r]]) {meets_stopped = meets_stopped || (piece_kind[piece] == kind_stopped);}
+		if (meets_stopped) {
+			if (stopped != NULL) {stopped->bounds.push_back({(int)stopped->members.size(), 0});}
+			for (int piece : merged[roots[r]]) {
+				if (stopped != NULL) {
+					stopped->members.insert(stopped->members.end(), pieces[piece].first, pieces[piece].first+pieces[piece].size());
+					stopped->bounds.back().second += pieces[piece].size();
+				}
+				if (piece_kind[piece] == kind_stopped) {continue;}
+				for (int i=0; i<pieces[piece].size(); i++) {coordinate.label[pieces[piece][i]] = label_rejected;}
+				metrics.points_flood_filled += pieces[piece].size();
+			}
+			continue;
+		}
+		whole.clear();
+		whole_stats.clear();
+		for (int piece : merged[roots[r]]) {
+			if (piece_kind[piece] == kind_deferred) {continue;}
+			for (int i=0; i<pieces[piece].size(); i++) {
+				whole.push_back(pieces[piece][i]);
+				whole_stats.add(coordinate.z[pieces[piece][i]]);
+			}
+		}
+		for (int piece : merged[roots[r]]) {
+			if (piece_kind[piece] != kind_deferred) {continue;}
+			for (int i=0; i<pieces[piece].size(); i++) {
+				int p = pieces[piece][i];
+				if (coordinate.z[p] >= whole_stats.min_z) {whole.push_back(p);} else {coordinate.label[p] = label_rejected;}
+			}
+		}
+		if (merged[roots[r]].size() > 1) {
+			whole_stats.clear();
+			for (int p : whole) {whole_stats.add(coordinate.z[p]);}
+			bool oversize = (params.growth_size_limit > 0) && (whole.size() > params.growth_size_limit);
+			if (oversize || (whole_stats.max_z-whole_stats.min_z < cluster_z_range_threshold)) {
+				if (oversize) {metrics.clusters_stopped_oversize++;} else {metrics.clusters_discarded_while_growing++;}
+				for (int piece : merged[roots[r]]) {
+					for (int i=0; i<pieces[piece].size(); i++) {coordinate.label[pieces[piece][i]] = label_rejected;}
+				}
+				continue;
+			}
+		}
+		int c = clusters.size(), start = clusters.members.size();
+		for (int p : whole) {
+			clusters.members.push_back(p);
+			coordinate.label[p] = c+1;
+		}
+		clusters.bounds.push_back({start, (int) whole.size()});
+		if ((trace != NULL) && (params.trace_level != trace_off)) { // (only final clusters are traced, even with trace_steps)
+			trace->add({pieces[merged[roots[r]][0]][0], c+1, 0, 2, clusters.bounds.back().second, 0}, coordinate, clusters.members.data()+start, NULL);
+		}
+	}
+	metrics.clusters_formed += clusters.size();
+}
+
+void Segmenter::form_clusters_preprocessed(PointCloud& coordinate, ClusterSet& clusters) {
+	// Most points of a map are ground (road, sidewalk), which clusters are grown through only to be discarded, & dense surfaces have far more
+	// points than needed to find their shape. So clusters are formed on fewer points:
+	// 1) Ground: the lowest z of each XY-cell of `ground_cell_size` is found & the points within `ground_band` of it are removed.
+	// 2) Downsampling: the points left are replaced by the centroid of each voxel of `downsample_voxel` (in the order of the 1st point of each voxel).
+	// Clusters are formed on the centroids (by form_clusters, so tiled growth, growth limit, ... apply), then each cluster gets back all the
+	// points (left after ground removal) of its voxels, in the order of the map. So the filters see clusters of the original density.
+	// Only the final clusters are traced & progress isn't printed.
+	PointCloud reduced; // index: voxel of the centroid
+	vector<int> voxel_start, voxel_points; // points (indices into `coordinate`) of voxel v: voxel_points[voxel_start[v]..voxel_start[v+1])
+	{
+		StageTimer timer(metrics, Metrics::stage_preprocess);
+		auto cell_key = [](float x, float y, float z, float size) { // (as VoxelGrid::cell_key)
+			return (((long long) floor(x/size) & 0x1FFFFF) << 42) | (((long long) floor(y/size) & 0x1FFFFF) << 21) | ((long long) floor(z/size) & 0x1FFFFF);
+		};
+		vector<char> ground(coordinate.size(), 0);
+		if (params.ground_cell_size > 0) {
+			unordered_map<long long, float> lowest; // XY-cell -> lowest z of its points
+			lowest.reserve(coordinate.size()/8);
+			vector<long long> cell(coordinate.size());
+			for (int p=0; p<coordinate.size(); p++) {
+				cell[p] = cell_key(coordinate.x[p], coordinate.y[p], 0, params.ground_cell_size);
+				auto it = lowest.emplace(cell[p], coordinate.z[p]).first;
+				it->second = min(it->second, coordinate.z[p]);
+			}
+			for (int p=0; p<coordinate.size(); p++) {
+				ground[p] = (coordinate.z[p] <= lowest[cell[p]]+params.ground_band);
+				metrics.ground_points_removed += ground[p];
+			}
+		}
+		vector<int> voxel_of(coordinate.size(), -1); // voxel of each point (-1 for ground)
+		vector<int> voxel_count;
+		unordered_map<long long, int> voxels;
+		voxels.reserve(coordinate.size());
+		float v = params.downsample_voxel;
+		for (int p=0; p<coordinate.size(); p++) {
+			if (ground[p]) {continue;}
+			if (v > 0) {
+				voxel_of[p] = voxels.emplace(cell_key(coordinate.x[p], coordinate.y[p], coordinate.z[p], v), voxel_count.size()).first->second;
+			} else {
+				voxel_of[p] = voxel_count.size(); // (each point is a voxel of its own)
+			}
+			if (voxel_of[p] == voxel_count.size()) {voxel_count.push_back(0);}
+			voxel_count[voxel_of[p]]++;
+		}
+		int num_voxels = voxel_count.size();
+		voxel_start.assign(num_voxels+1, 0);
+		for (int k=0; k<num_voxels; k++) {voxel_start[k+1] = voxel_start[k]+voxel_count[k];}
+		voxel_points.resize(voxel_start[num_voxels]);
+		vector<int> fill_pos(voxel_start.begin(), voxel_start.end()-1);
+		vector<double> sum_x(num_voxels, 0), sum_y(num_voxels, 0), sum_z(num_voxels, 0);
+		for (int p=0; p<coordinate.size(); p++) {
+			int k = voxel_of[p];
+			if (k < 0) {continue;}
+			voxel_points[fill_pos[k]++] = p; // (in the order of the map)
+			sum_x[k] += coordinate.x[p];
+			sum_y[k] += coordinate.y[p];
+			sum_z[k] += coordinate.z[p];
+		}
+		reduced.reserve(num_voxels);
+		for (int k=0; k<num_voxels; k++) {
+			reduced.push_back(sum_x[k]/voxel_count[k], sum_y[k]/voxel_count[k], sum_z[k]/voxel_count[k], k);
+		}
+	}
+
+	Segmenter segmenter(params);
+	segmenter.params.downsample_voxel = 0;
+	segmenter.params.ground_cell_size = 0;
+	segmenter.params.verbose = 0;
+	segmenter.pool = pool;
+	segmenter.metrics.enabled = metrics.enabled;
+	ClusterSet reduced_clusters;
+	segmenter.form_clusters(reduced, reduced_clusters);
+	segmenter.metrics.points = 0;
+	metrics.add(segmenter.metrics);
+	metrics.points += coordinate.size();
+
+	StageTimer timer(metrics, Metrics::stage_preprocess);
+	for (int k=0; k<reduced.size(); k++) { // points of the voxels of clusters rejected by the growth size limit
+		if (reduced.label[k] != label_rejected) {continue;}
+		for (int i=voxel_start[k]; i<voxel_start[k+1]; i++) {coordinate.label[voxel_points[i]] = label_rejected;}
+	}
+	clusters.members.clear();
+	clusters.bounds.clear();
+	for (int c=0; c<reduced_clusters.size(); c++) {
+		int start = clusters.members.size();
+		IndexSpan cluster = reduced_clusters[c];
+		for (int i=0; i<cluster.size(); i++) {
+			int k = reduced.index[cluster[i]];
+			clusters.members.insert(clusters.members.end(), voxel_points.begin()+voxel_start[k], voxel_points.begin()+voxel_start[k+1]);
+		}
+		sort(clusters.members.begin()+start, clusters.members.end());
+		for (int i=start; i<clusters.members.size(); i++) {coordinate.label[clusters.members[i]] = c+1;}
+		clusters.bounds.push_back({start, (int) clusters.members.size()-start});
+		if ((trace != NULL) && (params.trace_level != trace_off)) { // (only final clusters are traced, even with trace_steps)
+			trace->add({clusters.members[start], c+1, 0, 2, clusters.bounds.back().second, 0}, coordinate, clusters.members.data()+start, NULL);
+		}
+	}
+}
+
+vector<ClusterFilter> default_cluster_filters() {
+	return {
+		{"size", filter_size, 1, false, false, &Metrics::clusters_rejected_by_size, [](PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params) {
+			return (cluster.size() < params.cluster_size_low_threshold) || (cluster.size() > params.cluster_size_high_threshold);
+		}},
+		{"aspect", filter_aspect, 10, true, false, &Metrics::clusters_rejected_by_aspect, [](PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params) {
+			return (params.max_xy_aspect > 0) && (shape.length > params.max_xy_aspect*shape.width);
+		}},
+		{"flatness", filter_flatness, 10, true, false, &Metrics::clusters_rejected_by_flatness, [](PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params) {
+			return (params.min_height_to_footprint > 0) && (shape.height < params.min_height_to_footprint*shape.length);
+		}},
+		{"planarity", filter_planarity, 10, true, false, &Metrics::clusters_rejected_by_planarity, [](PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params) {
+			return (params.max_planarity > 0) && (shape.planarity > params.max_planarity);
+		}},
+		{"linearity", filter_linearity, 10, true, false, &Metrics::clusters_rejected_by_linearity, [](PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params) {
+			return (params.max_linearity > 0) && (shape.linearity > params.max_linearity);
+		}},
+		{"radius", filter_radius, 1000, false, true, &Metrics::clusters_rejected_by_radius, [](PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params) {
+			return cylinder.r > params.tree_radius_thresh;
+		}},
+		{"enclosure", filter_enclosure, 1010, false, true, &Metrics::clusters_rejected_by_enclosure, [](PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params) {
+			return check_if_cluster_resides_inside_median_cylinder(cloud, cluster, cylinder, params.cluster_enclosing_threshold) != 0;
+		}},
+	};
+}
+
+void use_shape_prefilters(SegmenterParams& params) {
+	params.max_xy_aspect = 8;
+	params.max_planarity = 0.85;
+	params.max_linearity = 0.995;
+	params.min_height_to_footprint = 0.07;
+}
+
+void Segmenter::filter_clusters(PointCloud& coordinate, const ClusterSet& clusters, FilterResult& result) {
+	// Filters run cheapest first (see ClusterFilter). With the default filters:
+	//  (a) Retain only clusters of size between `cluster_size_low_threshold` & `cluster_size_high_threshold` & discard the rest
+	//  (a') Discard clusters whose shape (found in linear time) can't be a tree: too elongated in XY, planar, linear or flat for their footprint
+	//  (b) Calculate the median cylinder radius of each cluster left & discard those clusters with radius > `tree_radius_thresh`
+	//  (c) Discard the clusters which reside completely inside the median cylinder
+	result.prefiltered_by.assign(clusters.size(), 0);
+	result.candidates.clear();
+	result.rejected_by.clear();
+	result.trees.clear();
+	vector<const ClusterFilter*> before, after; // filters run before & after median cylinders are found, cheapest first
+	for (int f=0; f<filters.size(); f++) {
+		(filters[f].needs_cylinder ? after : before).push_back(&filters[f]);
+	}
+	auto by_cost = [](const ClusterFilter* a, const ClusterFilter* b) {return a->cost < b->cost;};
+	stable_sort(before.begin(), before.end(), by_cost);
+	stable_sort(after.begin(), after.end(), by_cost);
+	bool after_needs_shape = any_of(after.begin(), after.end(), [](const ClusterFilter* f) {return f->needs_shape;});
+	vector<ClusterShape> shapes; // shape of each candidate (only kept if a filter run after the median cylinders needs it)
+	vector<IndexSpan> candidate_spans;
+	MedianCylinder no_cylinder = {};
+	{
+		StageTimer timer(metrics, Metrics::stage_size_filter);
+		ClusterShape shape;
+		for (int ag=0; ag<clusters.size(); ag++){
+			bool shape_found = false;
+			for (const ClusterFilter* f : before) {
+				if (f->needs_shape && !shape_found) {
+					find_cluster_shape(coordinate, clusters[ag], shape);
+					shape_found = true;
+				}
+				if (f->rejects(coordinate, clusters[ag], shape, no_cylinder, params)) {
+					result.prefiltered_by[ag] = f->id;
+					if (f->rejected != NULL) {metrics.*(f->rejected) += 1;}
+					break;
+				}
+			}
+			if (result.prefiltered_by[ag] != 0) {continue;}
+			result.candidates.push_back(ag);
+			candidate_spans.push_back(clusters[ag]);
+			if (after_needs_shape) {
+				if (!shape_found) {find_cluster_shape(coordinate, clusters[ag], shape);}
+				shapes.push_back(shape);
+			}
+		}
+	}
+	{
+		StageTimer timer(metrics, Metrics::stage_median_radius);
+		// median cylinders of all clusters left are found concurrently. Combinations are seeded by the number of the cluster (not of the candidate), so a cluster gets the same cylinder whatever the other filters are.
+		find_median_radius_of_clusters(coordinate, candidate_spans, result.cylinders, params, &result.candidates, pool);
+		for (int al=0; al<result.cylinders.size(); al++) {
+			metrics.triples_sampled += result.cylinders[al].num_triples;
+			metrics.degenerate_triples += result.cylinders[al].num_triples-result.cylinders[al].num_circles;
+		}
+	}
+	StageTimer timer(metrics, Metrics::stage_enclosure_filter);
+	ClusterShape no_shape = {};
+	for (int al=0; al<candidate_spans.size(); al++) {
+		result.rejected_by.push_back(0);
+		for (const ClusterFilter* f : after) {
+			if (f->rejects(coordinate, candidate_spans[al], after_needs_shape ? shapes[al] : no_shape, result.cylinders[al], params)) {
+				result.rejected_by[al] = f->id;
+				if (f->rejected != NULL) {metrics.*(f->rejected) += 1;}
+				break;
+			}
+		}
+		if (result.rejected_by[al] == 0) {result.trees.push_back(al);}
+	}
+	metrics.trees += result.trees.size();
+}
+
+void TileTreeMerger::add_tile(int tx, int ty, const PointCloud& cloud, const ClusterSet& clusters, const FilterResult& result, vector<pair<int,long long>>& points) {
+	shared.erase(shared.begin(), shared.lower_bound(ty)); // (no tile of this row or after contains points whose last row is before it)
+	points.clear();
+	auto tile_of = [&](float v) {return (int) floor(v/tile_size);};
+	for (int k=0; k<result.trees.size(); k++) {
+		IndexSpan cluster = clusters[result.candidates[result.trees[k]]];
+		double cx = 0, cy = 0;
+		for (int i=0; i<cluster.size(); i++) {
+			cx += cloud.x[cluster[i]];
+			cy += cloud.y[cluster[i]];
+		}
+		if ((tile_of(cx/cluster.size()) != tx) || (tile_of(cy/cluster.size()) != ty)) {continue;} // kept by the tile of its centroid
+		map<long long, int> earlier; // trees of earlier tiles sharing points with this one -> number of points shared
+		int start = points.size();
+		for (int i=0; i<cluster.size(); i++) {
+			int p = cluster[i];
+			auto row = shared.find(tile_of(cloud.y[p]+halo));
+			if (row != shared.end()) {
+				auto it = row->second.find(cloud.index[p]);
+				if (it != row->second.end()) {
+					earlier[it->second]++;
+					continue;
+				}
+			}
+			points.push_back({p, 0});
+		}
+		if (points.size() == start) {continue;} // (all its points are in earlier trees)
+		long long tree = 0; // the earlier tree sharing the most points (its new points are added to it), else a new tree
+		int most = 0;
+		for (auto& e : earlier) {
+			if (e.second > most) {
+				most = e.second;
+				tree = e.first;
+			}
+		}
+		if (tree == 0) {tree = ++trees;}
+		for (int j=start; j<points.size(); j++) {
+			int p = points[j].first;
+			points[j].second = tree;
+			bool in_halo_of_others = (tile_of(cloud.x[p]-halo) != tile_of(cloud.x[p]+halo)) || (tile_of(cloud.y[p]-halo) != tile_of(cloud.y[p]+halo));
+			if (in_halo_of_others) {shared[tile_of(cloud.y[p]+halo)][cloud.index[p]] = tree;}
+		}
+	}
+}
+
+void Segmenter::segment(const float* xyz, int num_points, vector<int>& labels, vector<MedianCylinder>& trees) {
+	PointCloud cloud;
+	cloud.reserve(num_points);
+	for (int i=0; i<num_points; i++) {
+		cloud.push_back(xyz[3*i], xyz[3*i+1], xyz[3*i+2], i);
+	}
+	ClusterSet clusters;
+	FilterResult result;
+	form_clusters(cloud, clusters);
+	filter_clusters(cloud, clusters, result);
+	labels.assign(num_points, 0);
+	trees.clear();
+	for (int t=0; t<result.trees.size(); t++) {
+		int candidate = result.trees[t];
+		IndexSpan cluster = clusters[result.candidates[candidate]];
+		for (int i=0; i<cluster.size(); i++) {
+			labels[cloud.index[cluster[i]]] = t+1;
+		}
+		trees.push_back(result.cylinders[candidate]);
+	}
+}
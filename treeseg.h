@@ -0,0 +1,443 @@
+// treeseg: segmentation of trees in 3D point clouds (of urban outdoors), without touching the filesystem.
+// The algorithm (see tree_segmenter.cpp & README.md) has 2 parts:
+// 1) Group the 3-D points into clusters. (Segmenter::form_clusters)
+// 2) Filter out irrelevant clusters to finally contain only those clusters corresponding to trees. (Segmenter::filter_clusters)
+//
+// Usage (from a program embedding the library):
+// 		Segmenter segmenter; // or Segmenter segmenter(params);
+// 		vector<int> labels; // per point: number of the tree (1, 2, ...) the point belongs to, 0 if it isn't part of any tree
+// 		vector<MedianCylinder> trees; // per tree: center & radius of its median cylinder, z-range & number of points
+// 		segmenter.segment(xyz, num_points, labels, trees); // xyz: x,y,z of all points (interleaved), owned by the caller
+// Build: `make` (builds libtreeseg.a & the command line tool `code` on top of it)
+
+#ifndef TREESEG_H
+#define TREESEG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+
+// Hyper-parameters of the algorithm (& of how it's run). Defaults are the values the algorithm was tuned with.
+struct SegmenterParams {
+	// ************************************ Various thresholds used *****************************************************
+	// Should tune these values & see if better results can be obtained
+	int combinations_threshold = 1000000; //hyper-parameter
+	float collinearity_threshold = 0.5;  //hyper-parameter
+	float proximity_threshold = 0.7;  //0.5 //hyper-parameter
+	float cluster_z_range_fraction = 0.4; // a cluster whose range of z is < cluster_z_range_fraction*(2*proximity_threshold) is discarded while it's grown //hyper-parameter
+	float tree_radius_thresh = 8.0;  //hyper-parameter
+	float cluster_enclosing_threshold = 1.0; //hyper-parameter
+	int cluster_size_low_threshold = 50; //hyper-parameter
+	int cluster_size_high_threshold = 2400; //hyper-parameter
+	float ground_z_band_fraction = 0.2; // ground removal: bottom band of a cluster, as a fraction of the cluster's range of z //hyper-parameter
+	float ground_points_fraction = 0.35; // ground removal: the band is removed if it holds at least this fraction of the cluster's points //hyper-parameter
+	// Pre-filters: linear-time tests on the shape of a cluster (see ClusterShape), which reject clusters before their median cylinders are found (0: disabled).
+	// Disabled by default: use_shape_prefilters sets the values which reject no cluster that passes the 3 stages of filtering on the 17 maps,
+	// which are also the maps they were tuned on (so they only save time on similar scenes; `treeseg_bench --check` checks them on synthetic ones).
+	float max_xy_aspect = 0; // XY-projection longer than this many times its width (facades, curbs, fences) //hyper-parameter
+	float max_planarity = 0; // planar (facades, walls) //hyper-parameter
+	float max_linearity = 0; // linear (poles, wires) //hyper-parameter
+	float min_height_to_footprint = 0; // range of z smaller than this fraction of the length of the XY-projection (cars, low walls) //hyper-parameter
+	// ******************************************************************************************************************
+
+	// Preprocessing (see Segmenter::form_clusters_preprocessed): clusters are formed on fewer points, then the points of the map are put back into them.
+	float downsample_voxel = 0; // if > 0, clusters are formed on the centroids of the points in each voxel (cube) of this size (in metres)
+	float ground_cell_size = 0; // if > 0, points within `ground_band` of the lowest point of their XY-cell (square of this size, in metres) are removed as ground before clustering
+	float ground_band = 0.3; // (in metres) //hyper-parameter
+
+	int num_threads = 0; // number of threads used to find the median cylinders of clusters & to grow clusters in tiles (0: use all cores)
+	int growth_size_limit = 0; // if > 0, growth of a cluster stops as soon as it has more than this many points after a step of growth (& its ground removal): the rest of its connected component is claimed by a flood fill (so it seeds no cluster) & all its points are labeled label_rejected (0: clusters grow until no neighbors remain)
+	float cluster_tile_size = 0; // if > 0, clusters are grown concurrently in tiles of this size (in metres, in XY) & merged across the borders of tiles (see Segmenter::form_clusters_tiled)
+	long long rng_seed = -1; // if a seed (0 to 2^32-1), random combination i of each cluster is a function of (rng_seed, cluster number, i) only, which makes the output reproducible (& independent of num_threads & of the order in which clusters are run). rng_unseeded: different combinations across executions
+	float xy_dedup_epsilon = 0.005; // points of a cluster whose (x,y) pairs are equal after quantizing to this grid (in metres) are considered duplicates while finding the median cylinder
+
+	// Estimator of the median cylinder.
+	// 	exact (0): median of circles through all `combinations_threshold` random combinations.
+	// 	sequential (1): combinations are drawn in batches & drawing stops as soon as the confidence intervals of the medians of x, y & r are narrower than `median_tolerance`,
+	// 				or the radius is clearly (with confidence) larger than `tree_radius_thresh`.
+	int median_estimator_sequential = 0;
+	float median_tolerance = 0.05; // (sequential estimator) width (in metres) of the confidence intervals at which drawing stops
+	float median_confidence_z = 3.0; // (sequential estimator) z-score of the confidence intervals
+	int median_min_samples = 2048; // (sequential estimator) number of circles after which convergence is checked for the 1st time (& then after every doubling)
+
+	// Curvature engine of the median cylinder (circle_fit_*).
+	// 	circle_fit_median: median of the circles through `combinations_threshold` random combinations of 3 points (as described above).
+	// 	circle_fit_kasa, circle_fit_pratt, circle_fit_taubin: algebraic least-squares fit of one circle to the XY-projection of the cluster, in linear time.
+	int circle_fit = 0;
+	int circle_fit_ransac_iterations = 0; // (algebraic fits) if > 0, the circle is refit to the inliers of the best of this many circles through random combinations
+	float circle_fit_ransac_tolerance = 0.1; // (RANSAC) largest distance (in metres) of an inlier from the circle
+
+	int trace_level = 1; // what is given to the trace sink (if any) while forming clusters: trace_off, trace_final or trace_steps
+	int verbose = 0; // if non-zero, progress of forming clusters is printed to cout
+};
+
+const int label_rejected = -2; // label of the points of a cluster rejected while it's grown (for too small a range of z, or for reaching SegmenterParams::growth_size_limit)
+
+const long long rng_unseeded = -1; // SegmenterParams::rng_seed of a run which isn't reproducible (a value outside the range of seeds, so that every seed can be chosen)
+
+const int circle_fit_median = 0, circle_fit_kasa = 1, circle_fit_pratt = 2, circle_fit_taubin = 3;
+
+// Points of a map (or of a set of clusters) stored as flat x/y/z arrays (structure-of-arrays), instead of one heap-allocated vector<float> per point.
+struct PointCloud {
+	std::vector<float> x, y, z;
+	std::vector<int> index; // index of the point in the wrl file (or buffer) it was read from
+	std::vector<int> label; // number of the cluster the point belongs to (-1 if the point isn't part of any cluster, label_rejected if its cluster was rejected while it was grown)
+
+	int size() const {
+		return x.size();
+	}
+
+	void reserve(int n) {
+		x.reserve(n);
+		y.reserve(n);
+		z.reserve(n);
+		index.reserve(n);
+		label.reserve(n);
+	}
+
+	void push_back(float px, float py, float pz, int idx, int lbl = -1) {
+		x.push_back(px);
+		y.push_back(py);
+		z.push_back(pz);
+		index.push_back(idx);
+		label.push_back(lbl);
+	}
+};
+
+// A cluster refers to its points by their indices into a PointCloud (instead of holding copies of the points).
+// The indices of a cluster are a contiguous run (span) of some vector<int>, which must outlive the span.
+struct IndexSpan {
+	const int* first;
+	int count;
+
+	IndexSpan(const int* f, int c) : first(f), count(c) {}
+	IndexSpan(const std::vector<int>& v) : first(v.data()), count(v.size()) {}
+
+	int size() const {
+		return count;
+	}
+
+	int operator[](int i) const {
+		return first[i];
+	}
+};
+
+// Clusters formed in the 1st part of algo: indices of the points of all clusters, stored cluster after cluster.
+struct ClusterSet {
+	std::vector<int> members; // indices (into the PointCloud) of the points of all clusters
+	std::vector<std::pair<int,int>> bounds; // (start, size) of each cluster in `members`
+
+	int size() const {
+		return bounds.size();
+	}
+
+	IndexSpan operator[](int i) const {
+		return IndexSpan(members.data()+bounds[i].first, bounds[i].second);
+	}
+};
+
+// Median cylinder of a cluster (& the z-range of the cluster, so that the cylinder can be drawn around the cluster).
+// Also the descriptor of a segmented tree.
+struct MedianCylinder {
+	float x, y, r; // center & radius
+	float min_z, max_z;
+	int num_points; // number of points of the cluster
+	long long num_triples; // number of random combinations of 3 points drawn
+	long long num_circles; // number of circles the median is taken over (the other triples are collinear or have no real circle)
+	bool converged; // (sequential estimator) true if drawing of combinations stopped early
+};
+
+// Shape of a cluster, found in linear time (used by the pre-filters, which reject clusters before their median cylinders are found).
+struct ClusterShape {
+	float length, width; // extents of the XY-projection along its principal axes (length >= width)
+	float height; // range of z
+	float linearity, planarity; // (l1-l2)/l1 & (l2-l3)/l1, for the eigenvalues l1 >= l2 >= l3 of the covariance of the points
+};
+
+// Output of the 2nd part of algo.
+struct FilterResult {
+	std::vector<int> prefiltered_by; // per cluster (of the ClusterSet): id of the filter which rejected it before median cylinders were found, 0 if it's a candidate
+	std::vector<int> candidates; // clusters of relevant sizes & shapes (which passed the filters run before median cylinders are found), as indices into the ClusterSet
+	std::vector<MedianCylinder> cylinders; // median cylinder of each candidate
+	std::vector<int> rejected_by; // per candidate: id of the filter (filter_radius or filter_enclosure) which discarded it, 0 if it's a tree
+	std::vector<int> trees; // candidates which passed all filters (as indices into `candidates`), in order
+};
+
+// Trace of the growth of clusters (1st part of algo).
+// 	trace_off: no trace.
+// 	trace_final: final points of each cluster.
+// 	trace_steps: points added (before ground removal) & removed (by ground removal) at every step of growth of every cluster (including clusters which get discarded).
+const int trace_off = 0, trace_final = 1, trace_steps = 2;
+
+// Record of the trace: {growth attempt, cluster number, step, phase, number of added points, number of removed points}.
+// The points of a cluster (in order) are recovered by starting from an empty cluster at each new growth attempt, appending the added points & (stably) erasing the removed ones.
+struct TraceRecordHeader {
+	int32_t attempt; // growth attempt (one per seed point, unique, unlike the cluster number which is reused when a cluster is discarded)
+	int32_t cluster;
+	int32_t step;
+	int32_t phase; // 0: before ground removal, 1: after ground removal, 2: final cluster
+	int32_t num_added;
+	int32_t num_removed;
+};
+
+// Receiver of the trace records (e.g. a file writer). Called from the thread forming the clusters.
+struct ClusterTraceSink {
+	// added[0..header.num_added) & removed[0..header.num_removed) are indices into `cloud`.
+	virtual void add(TraceRecordHeader header, PointCloud& cloud, const int* added, const int* removed) = 0;
+	virtual ~ClusterTraceSink() {}
+};
+
+// Stage timers (in ns) & counters of the runs of a Segmenter (accumulated over runs, until clear()).
+// Timers are read only if `enabled`, so a disabled timer costs a branch. Counters are accumulated locally (per call/cluster) & added once, so they're always kept.
+struct Metrics {
+	enum Stage {stage_parse, stage_preprocess, stage_cluster_growth, stage_ground_removal, stage_size_filter, stage_median_radius, stage_enclosure_filter, stage_output, num_stages};
+	bool enabled = false;
+	long long stage_ns[num_stages] = {}; // (cluster growth includes ground removal, size filter includes the pre-filters. Parse & output are timed by the caller.)
+	long long points = 0; // points given to form_clusters
+	long long ground_points_removed = 0; // points removed as ground by the preprocessing
+	long long points_clustered = 0; // points clusters were formed on (after preprocessing; voxel centroids, if downsampled)
+	long long neighbor_distance_evals = 0; // distances computed while finding neighbors of cluster points
+	long long points_erased = 0; // points removed from clusters by ground removal
+	long long clusters_formed = 0;
+	long long clusters_discarded_while_growing = 0; // clusters discarded because of too small a range of z
+	long long clusters_stopped_oversize = 0; // clusters whose growth was stopped at SegmenterParams::growth_size_limit
+	long long points_flood_filled = 0; // points the stopped clusters hadn't reached, claimed by a flood fill of the rest of their connected components (each is searched for neighbors once, but never seeds a cluster or goes through ground removal)
+	long long triples_sampled = 0; // random combinations of 3 points drawn while finding median cylinders
+	long long degenerate_triples = 0; // combinations through which there is no circle (collinear or no real radius)
+	long long clusters_rejected_by_size = 0; // 1st stage of filtering
+	long long clusters_rejected_by_radius = 0; // 2nd stage of filtering
+	long long clusters_rejected_by_enclosure = 0; // 3rd stage of filtering
+	long long clusters_rejected_by_aspect = 0, clusters_rejected_by_planarity = 0, clusters_rejected_by_linearity = 0, clusters_rejected_by_flatness = 0; // pre-filters
+	long long trees = 0;
+
+	void clear() {
+		bool was_enabled = enabled;
+		*this = Metrics();
+		enabled = was_enabled;
+	}
+
+	void add(const Metrics& other); // adds the timers & counters of `other`
+
+	std::string to_json() const;
+};
+
+// Adds the time from its construction to its destruction to a stage of `metrics` (if metrics are enabled).
+struct StageTimer {
+	Metrics& metrics;
+	int stage;
+	std::chrono::steady_clock::time_point start;
+
+	StageTimer(Metrics& m, int s) : metrics(m), stage(s) {
+		if (metrics.enabled) {start = std::chrono::steady_clock::now();}
+	}
+
+	~StageTimer() {
+		if (metrics.enabled) {metrics.stage_ns[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();}
+	}
+};
+
+// Tasks waited for together (e.g. the median cylinders of the clusters of one map).
+struct TaskGroup {
+	std::atomic<int> pending{0}; // tasks submitted & not finished yet
+	std::atomic<int> queued{0}; // tasks submitted & not started yet
+};
+
+// Pool of threads running tasks, with work stealing: each worker pushes the tasks it submits to the back of its own deque & takes its next task
+// from the back too (most recent first, whose data is likely still in cache). A worker whose deque is empty takes a task submitted from outside
+// the pool or steals the oldest task of another worker. Tasks may submit tasks & wait for them, so tasks of different sizes & levels
+// (e.g. whole maps & single clusters of those maps) share all cores. A waiting thread runs only tasks of the group it waits for (so that
+// a task waiting for its small subtasks doesn't end up running a whole unrelated map in the meantime).
+struct TaskPool {
+	// `num_threads` threads run tasks (0: all cores): num_threads-1 workers & the thread calling wait().
+	TaskPool(int num_threads = 0);
+	~TaskPool();
+
+	void submit(std::function<void()> task, TaskGroup* group = NULL);
+	// Runs tasks of `group` until all of them are done.
+	void wait(TaskGroup& group);
+	int size() const { // number of threads running tasks
+		return workers.size()+1;
+	}
+	double idle_fraction() const; // fraction of the time the workers (since the pool was created) had no task to run
+
+private:
+	struct Task {
+		std::function<void()> run;
+		TaskGroup* group;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+	std::vector<std::unique_ptr<Queue>> queues; // one per worker & (last) one for tasks submitted from outside the pool
+	std::vector<std::thread> workers;
+	std::atomic<int> queued{0}; // tasks in all queues
+	std::atomic<bool> stopping{false};
+	std::mutex sleep_mutex;
+	std::condition_variable wake; // (workers & threads waiting for a group both sleep on it, so it's always notified to all)
+	std::atomic<long long> idle_ns{0};
+	std::chrono::steady_clock::time_point created;
+
+	int own_queue(); // queue of the calling thread
+	bool run_one(int self, TaskGroup* only = NULL);
+	void worker_loop(int self);
+};
+
+// Filters of the 2nd part of algo (ids of the filters, as found in FilterResult).
+const int filter_size = 1, filter_radius = 2, filter_enclosure = 3, filter_aspect = 4, filter_planarity = 5, filter_linearity = 6, filter_flatness = 7;
+
+// A filter of the 2nd part of algo, which rejects a cluster given its points, its shape (if `needs_shape`) & its median cylinder (if `needs_cylinder`).
+// Filters run cheapest first (by `cost`): the filters which don't need the median cylinder run on all clusters, before any median cylinder is found;
+// the others run on the clusters left, once their median cylinders are found. A cluster is rejected by the 1st filter which rejects it.
+struct ClusterFilter {
+	std::string name;
+	int id; // filter_* (or any other id > 0, for other filters)
+	int cost; // relative cost per cluster (order of the filters)
+	bool needs_shape, needs_cylinder;
+	long long Metrics::* rejected; // counter (of Metrics) of the clusters it rejects (NULL: not counted)
+	std::function<bool(PointCloud& cloud, IndexSpan cluster, const ClusterShape& shape, const MedianCylinder& cylinder, const SegmenterParams& params)> rejects;
+};
+
+// Size filter, pre-filters (aspect, planarity, linearity, flatness), radius filter & enclosure filter.
+std::vector<ClusterFilter> default_cluster_filters();
+// Enables the pre-filters, with the thresholds tuned on the 17 maps (max_xy_aspect 8, max_planarity 0.85, max_linearity 0.995, min_height_to_footprint 0.07).
+void use_shape_prefilters(SegmenterParams& params);
+
+struct Segmenter {
+	SegmenterParams params;
+	ClusterTraceSink* trace = NULL; // if set, growth of clusters is traced (as per params.trace_level)
+	TaskPool* pool = NULL; // if set, median cylinders of clusters are found on this (shared) pool, instead of on `params.num_threads` threads of their own
+	ClusterSet* stopped = NULL; // if set, form_clusters appends to it the points of each cluster stopped at params.growth_size_limit (with the rest of its connected component; in tiles, with the pieces it meets across borders)
+	// Set by form_clusters_tiled on the Segmenter of each tile: a cluster which fails the test of its range of z once it has points within
+	// proximity_threshold of the border of the tile (near_border[point] != 0) may continue across the border, so instead of being discarded,
+	// it's appended to `deferred` & the test is done on the cluster it's merged into.
+	const std::vector<char>* near_border = NULL;
+	ClusterSet* deferred = NULL;
+	Metrics metrics;
+	std::vector<ClusterFilter> filters = default_cluster_filters(); // filters of the 2nd part of algo (others can be added)
+
+	Segmenter() {}
+	Segmenter(const SegmenterParams& p) : params(p) {}
+
+	// 1st part of algo: groups the points of `cloud` into `clusters` (& sets the label of each point to the number of its cluster).
+	void form_clusters(PointCloud& cloud, ClusterSet& clusters);
+	// 1st part of algo, on tiles of the map concurrently (used by form_clusters if params.cluster_tile_size > 0).
+	void form_clusters_tiled(PointCloud& cloud, ClusterSet& clusters);
+	// 1st part of algo, on the points left by the preprocessing (used by form_clusters if params.downsample_voxel > 0 or params.ground_cell_size > 0).
+	void form_clusters_preprocessed(PointCloud& cloud, ClusterSet& clusters);
+	// 2nd part of algo: filters out the clusters which aren't trees.
+	void filter_clusters(PointCloud& cloud, const ClusterSet& clusters, FilterResult& result);
+	// Whole algo on the points xyz[3*i], xyz[3*i+1], xyz[3*i+2] (i < num_points).
+	// labels[i] is set to the number of the tree (1, 2, ...) point i belongs to (0 if it isn't part of any tree) & trees[t-1] to the descriptor of tree t.
+	void segment(const float* xyz, int num_points, std::vector<int>& labels, std::vector<MedianCylinder>& trees);
+};
+
+// Trees of a map which is segmented tile by tile (square tiles of `tile_size` in XY, each segmented with the points of a halo of `halo` around it,
+// in the order of their rows & columns, like `./code --stream`). A tree is kept by the tile containing the centroid (in XY) of its cluster.
+// Nothing guarantees that a tree near the border of tiles has the same cluster in each tile which sees it (unless the halo covers the whole
+// tree), so the trees kept are deduplicated point by point: a point already given (to a tree) by an earlier tile isn't given again, & the new
+// points of a tree which shares points with earlier trees are given to the tree it shares the most points with. So every point is in at most
+// one tree. (A tree may still be lost if its centroid falls outside the tile in every tile which sees it.)
+// Only the points which lie in the halo of other tiles are remembered, & only until the last row of tiles which contains them is done.
+struct TileTreeMerger {
+	float tile_size, halo;
+	long long trees = 0; // number of trees so far
+	std::map<int, std::unordered_map<int, long long>> shared; // last row of tiles containing a point -> (index of the point in the map -> its tree)
+
+	TileTreeMerger(float size, float h) : tile_size(size), halo(h) {}
+
+	// Tree of each point of the trees of tile (tx, ty), which no earlier tile gave: `points` gets (index into `cloud` (the points of the tile
+	// & its halo, whose `index` is the index in the map), tree number) in the order of the trees of `result`. Tiles must be added row by row.
+	void add_tile(int tx, int ty, const PointCloud& cloud, const ClusterSet& clusters, const FilterResult& result, std::vector<std::pair<int,long long>>& points);
+};
+
+// ************************************ Stages of the algorithm ************************************
+// (used by Segmenter & exposed for benchmarking/testing the stages in isolation)
+
+// Statistics of the cluster being grown, updated as points are added to (or removed from) the cluster, instead of scanning the whole cluster after every point is expanded.
+// Keeps number of points, min & max of z & a histogram of z (with bins of width `z_hist_bin_width`).
+// The histogram gives the number of points in the bottom band of the cluster (for ground removal) without scanning the points of the cluster.
+const float z_hist_bin_width = 0.05;
+
+struct ClusterStats {
+	int count;
+	float max_z, min_z;
+	int first_bin; // bin number of hist[0]
+	std::vector<int> hist; // number of points of the cluster in each bin of z
+
+	void clear() {
+		count = 0;
+		max_z = -1000;
+		min_z = 1000;
+		first_bin = 0;
+		hist.clear();
+	}
+
+	int bin_of(float z) { // non-decreasing in z, so z1 < z2 whenever bin_of(z1) < bin_of(z2)
+		return (int) floor(z/z_hist_bin_width);
+	}
+
+	void add(float z) {
+		int b = bin_of(z);
+		if (hist.empty()) {first_bin = b;}
+		if (b < first_bin) {
+			hist.insert(hist.begin(), first_bin-b, 0);
+			first_bin = b;
+		}
+		if (b-first_bin >= hist.size()) {hist.resize(b-first_bin+1, 0);}
+		hist[b-first_bin]++;
+		count++;
+		if (z>max_z){max_z = z;}
+		if (z<min_z){min_z = z;}
+	}
+
+	void remove(float z) { // (min_z & max_z aren't updated)
+		hist[bin_of(z)-first_bin]--;
+		count--;
+	}
+
+	int count_in_bins_below(int b) { // number of points in bins < b
+		int n = 0;
+		for (int i=0; (i < hist.size()) && (first_bin+i < b); i++) {n += hist[i];}
+		return n;
+	}
+};
+
+void remove_ground_pts_from_cluster(PointCloud& cloud, std::vector<int>& curr_cluster, ClusterStats& stats, float z_coord_threshold, float num_points_threshold, std::vector<int>* removed = NULL);
+float distance_bw_points (PointCloud& cloud, int point1, int point2);
+
+// Batch of triples of points (XY-plane projections) & the circles through them, stored as structure-of-arrays (see fit_circles).
+const int circle_batch_size = 256;
+
+struct CircleBatch {
+	alignas(32) float x0[circle_batch_size], y0[circle_batch_size];
+	alignas(32) float x1[circle_batch_size], y1[circle_batch_size];
+	alignas(32) float x2[circle_batch_size], y2[circle_batch_size];
+	alignas(32) float s[circle_batch_size], t[circle_batch_size], r[circle_batch_size]; // center & radius of the circle through triple i
+	alignas(32) int valid[circle_batch_size]; // non-zero if there is a circle through triple i
+	int size = 0;
+};
+
+void fit_circles(CircleBatch& b);
+void find_median_radius (PointCloud& cloud, IndexSpan cluster, int curr_cluster_num, const SegmenterParams& params, MedianCylinder& result);
+void find_median_radius_of_clusters (PointCloud& cloud, std::vector<IndexSpan>& clusters, std::vector<MedianCylinder>& results, const SegmenterParams& params, const std::vector<int>* cluster_nums = NULL, TaskPool* task_pool = NULL);
+// Algebraic fit (circle_fit_kasa, circle_fit_pratt or circle_fit_taubin) of a circle to the XY-projections of points pts[0..n) of `cloud`. Returns false if there is no circle (fewer than 3 distinct points, or collinear points).
+bool fit_circle_algebraic (PointCloud& cloud, const int* pts, int n, int method, float& cx, float& cy, float& r);
+int count_points_inside_median_cylinder (PointCloud& cloud, IndexSpan cluster, const MedianCylinder& cylinder); // points whose XY-projections are within the cylinder
+int check_if_cluster_resides_inside_median_cylinder (PointCloud& cloud, IndexSpan cluster, const MedianCylinder& cylinder, float enclosing_threshold);
+void find_cluster_shape (PointCloud& cloud, IndexSpan cluster, ClusterShape& shape); // O(n)
+
+#endif
@@ -0,0 +1,615 @@
+// Benchmark of the stages of the segmentation algorithm (treeseg.h) on synthetic urban scenes.
+// A scene is a grid of 40m x 40m blocks, each with a ground plane, trees (cylindrical trunk & spherical crown), a facade & poles.
+// Scenes are generated deterministically (from `--seed`), so timings of different builds are comparable.
+// Stages benchmarked (each on every scene size):
+// 	growth:    forming clusters (region growing, which includes ground removal at every step of growth)
+// 	tiled/T:   forming clusters in tiles of 20 m (cluster_tile_size) on T = 1, 2, 4 & all hardware threads
+// 	ground:    remove_ground_pts_from_cluster, on each cluster formed in the scene (with the ground around its base added back)
+// 	circles:   fitting circles to random triples of points (fit_circles)
+// 	median:    median cylinders of the clusters of relevant sizes (find_median_radius, 1 thread)
+// 	kasa, pratt, taubin: the algebraic circle fits (SegmenterParams::circle_fit), on the same clusters (1 thread)
+// 	ransac:    Taubin's fit with 100 iterations of RANSAC, on the same clusters (1 thread)
+// 	enclosure: check_if_cluster_resides_inside_median_cylinder, on the clusters of relevant sizes
+// For every stage, throughput & the scaling exponent (slope of log(time) vs log(number of points), between consecutive sizes) is printed,
+// then the speedup of tiled growth on T threads over 1 thread.
+// Checks (`--check`, also run by `make check`): properties the algorithm must keep on any scene, checked on every scene size (instead of timing the stages).
+// 	tiled_rejections: with growth_size_limit & cluster_tile_size, the points of clusters rejected while they're grown are labeled label_rejected
+// 		in the map (with a single tile, exactly the points rejected by sequential growth)
+// 	stopped_components: with growth_size_limit, a stopped cluster claims the rest of its connected component, so no point of a cluster grown
+// 		after it is within proximity_threshold of it (nor, in tiles, a point of a cluster across the border of its tile)
+// 	tiled_border_trees: trees cut by the border of 2 tiles are found as single trees by tiled growth, each with the points sequential growth
+// 		finds for it, apart from points ground removal removed in either run & points in the bottom band of the tree (see Segmenter::form_clusters_tiled)
+// 	tiled_border_limit: a growth_size_limit which the pieces of those trees are under, but not the whole trees, stops them in tiles too
+// 	prefilters_keep_trees: the pre-filters (with the thresholds of use_shape_prefilters) reject no cluster which the size, radius & enclosure filters accept
+// 	stream_border_trees: trees straddling the border of 2 tiles, segmented tile by tile with halos (as by `./code --stream`, with TileTreeMerger),
+// 		are exactly the trees of the whole map with a halo covering the trees, & no point is in 2 trees even with a halo narrower than the trees
+// A line is printed per check & scene, & the exit status is 1 if any check fails.
+// Usage: make bench && ./treeseg_bench [--sizes 10000,100000,1000000,10000000] [--density D] [--combinations C] [--seed S] [--csv file] [--check]
+// 		--sizes: numbers of points of the scenes (default: 10^4, 10^5, 10^6 & 10^7)
+// 		--density: points per m^2 of every surface (default: 4)
+// 		--combinations: random combinations per cluster in the `median` stage (default: 100000, the algorithm uses 1000000)
+// 		--csv: also write the results into a csv file
+// 		--check: run the checks instead of the benchmark (default sizes: 10^4 & 10^5)
+
+#include <bits/stdc++.h>
+#include "treeseg.h"
+
+using namespace std;
+
+struct SceneParams {
+	float density = 4; // points per m^2
+	unsigned int seed = 1;
+};
+
+// Points on the surface of the objects of a scene, generated block by block until there are at least `num_points` points.
+void generate_scene(int num_points, SceneParams& scene, PointCloud& cloud) {
+	const float block = 40; // size of a block (m)
+	mt19937 gen(scene.seed);
+	uniform_real_distribution<float> unit(0, 1);
+	normal_distribution<float> noise(0, 0.03); // sensor noise (m)
+	float d = scene.density;
+	auto count_of = [&](float area) { // number of points on a surface of `area` m^2
+		float n = area*d;
+		int whole = (int) n;
+		return whole + ((unit(gen) < n-whole) ? 1 : 0);
+	};
+	auto add = [&](float x, float y, float z) {
+		if (cloud.size() < num_points) {cloud.push_back(x+noise(gen), y+noise(gen), z+noise(gen), cloud.size());}
+	};
+	auto add_cylinder = [&](float cx, float cy, float r, float z0, float z1) {
+		int n = count_of(2*M_PI*r*(z1-z0));
+		for (int i=0; i<n; i++) {
+			float a = 2*M_PI*unit(gen);
+			add(cx+r*cos(a), cy+r*sin(a), z0+(z1-z0)*unit(gen));
+		}
+	};
+	int blocks_per_row = 1;
+	cloud.reserve(num_points);
+	for (int b=0; cloud.size() < num_points; b++) {
+		if (b >= blocks_per_row*blocks_per_row) {blocks_per_row++;} // blocks are laid out in a square which grows as needed (block b is at (b%row, b/row) of the current square)
+		float bx = block*(b%blocks_per_row), by = block*(b/blocks_per_row);
+		// ground plane
+		int n = count_of(block*block);
+		for (int i=0; i<n; i++) {
+			add(bx+block*unit(gen), by+block*unit(gen), 0);
+		}
+		// facade along one side of the block
+		float facade_len = 10+20*unit(gen), facade_h = 8+7*unit(gen), facade_x = bx+(block-facade_len)*unit(gen);
+		n = count_of(facade_len*facade_h);
+		for (int i=0; i<n; i++) {
+			add(facade_x+facade_len*unit(gen), by+1, facade_h*unit(gen));
+		}
+		// trees: trunk & crown
+		for (int t=0; t<4; t++) {
+			float cx = bx+5+30*unit(gen), cy = by+8+28*unit(gen);
+			float trunk_r = 0.15+0.25*unit(gen), trunk_h = 2+2*unit(gen), crown_r = 1.5+1.5*unit(gen);
+			add_cylinder(cx, cy, trunk_r, 0, trunk_h);
+			float cz = trunk_h+crown_r*0.8;
+			n = count_of(4*M_PI*crown_r*crown_r);
+			for (int i=0; i<n; i++) {
+				float u = 2*unit(gen)-1, a = 2*M_PI*unit(gen), s = sqrt(1-u*u);
+				add(cx+crown_r*s*cos(a), cy+crown_r*s*sin(a), cz+crown_r*u);
+			}
+		}
+		// poles
+		for (int p=0; p<2; p++) {
+			add_cylinder(bx+block*unit(gen), by+3+2*unit(gen), 0.1, 0, 6+3*unit(gen));
+		}
+	}
+}
+
+// A 30m x 30m block of ground with 3 trees whose trunks stand on the line x = `border` (so, in tiles of 15m, every tree is cut by the border of 2 tiles).
+void generate_border_scene(float border, SceneParams& scene, PointCloud& cloud) {
+	mt19937 gen(scene.seed);
+	uniform_real_distribution<float> unit(0, 1);
+	normal_distribution<float> noise(0, 0.03);
+	float d = 4*scene.density; // (trees of a few points are cut into pieces too small to be grown on their own)
+	auto add = [&](float x, float y, float z) {cloud.push_back(x+noise(gen), y+noise(gen), z+noise(gen), cloud.size());};
+	for (int i=0; i<30*30*d; i++) {
+		add(30*unit(gen), 30*unit(gen), 0);
+	}
+	for (int t=0; t<3; t++) {
+		float cx = border, cy = 5+10*t, trunk_r = 0.3, trunk_h = 3, crown_r = 1.5;
+		for (int i=0; i<2*M_PI*trunk_r*trunk_h*d; i++) {
+			float a = 2*M_PI*unit(gen);
+			add(cx+trunk_r*cos(a), cy+trunk_r*sin(a), trunk_h*unit(gen));
+		}
+		for (int i=0; i<4*M_PI*crown_r*crown_r*d; i++) {
+			float u = 2*unit(gen)-1, a = 2*M_PI*unit(gen), s = sqrt(1-u*u);
+			add(cx+crown_r*s*cos(a), cy+crown_r*s*sin(a), trunk_h+crown_r*0.8+crown_r*u);
+		}
+	}
+}
+
+struct StageResult {
+	string stage;
+	int num_points; // points of the scene
+	long long work; // number of items processed by the stage (points or circles)
+	string unit; // what `work` counts
+	double seconds;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
+
+void bench_scene(int num_points, SceneParams& scene, int combinations, vector<StageResult>& results) {
+	PointCloud cloud;
+	generate_scene(num_points, scene, cloud);
+	SegmenterParams params;
+	params.rng_seed = scene.seed;
+	params.num_threads = 1;
+	params.combinations_threshold = combinations;
+	Segmenter segmenter(params);
+
+	// growth
+	ClusterSet clusters;
+	auto start = chrono::steady_clock::now();
+	segmenter.form_clusters(cloud, clusters);
+	results.push_back({"growth", num_points, cloud.size(), "points", seconds_since(start)});
+
+	// tiled/T: the same growth in tiles of 20 m (SegmenterParams::cluster_tile_size), on T threads
+	set<int> thread_counts = {1, 2, 4, max(1, (int) thread::hardware_concurrency())};
+	for (int num_threads : thread_counts) {
+		PointCloud tiled_cloud = cloud;
+		ClusterSet tiled_clusters;
+		Segmenter tiled(params);
+		tiled.params.cluster_tile_size = 20;
+		tiled.params.num_threads = num_threads;
+		start = chrono::steady_clock::now();
+		tiled.form_clusters(tiled_cloud, tiled_clusters);
+		results.push_back({"tiled/"+to_string(num_threads), num_points, cloud.size(), "points", seconds_since(start)});
+	}
+
+	// ground: each cluster together with the points (of the map) below it, which ground removal should remove again
+	vector<vector<int>> ground_inputs;
+	vector<ClusterStats> ground_stats;
+	long long ground_points = 0;
+	const float cell = 2; // points which aren't in any cluster are put into a 2D grid (of cells of `cell` m), to find those within the footprint of a cluster
+	auto cell_key = [&](int cx, int cy) {return ((long long) cx << 32) ^ (unsigned int) cy;};
+	unordered_map<long long, vector<int>> ground_cells;
+	for (int p=0; p<cloud.size(); p++) {
+		if (cloud.label[p] < 0) {ground_cells[cell_key(floor(cloud.x[p]/cell), floor(cloud.y[p]/cell))].push_back(p);}
+	}
+	for (int c=0; c<clusters.size(); c++) {
+		IndexSpan cluster = clusters[c];
+		if (cluster.size() < params.cluster_size_low_threshold) {continue;}
+		float min_x = 1e30, max_x = -1e30, min_y = 1e30, max_y = -1e30;
+		vector<int> points(cluster.first, cluster.first+cluster.size());
+		for (int i=0; i<cluster.size(); i++) {
+			min_x = min(min_x, cloud.x[cluster[i]]);
+			max_x = max(max_x, cloud.x[cluster[i]]);
+			min_y = min(min_y, cloud.y[cluster[i]]);
+			max_y = max(max_y, cloud.y[cluster[i]]);
+		}
+		for (int cx=floor(min_x/cell); cx<=floor(max_x/cell); cx++) { // points which aren't in any cluster (ground) within the footprint of the cluster
+			for (int cy=floor(min_y/cell); cy<=floor(max_y/cell); cy++) {
+				auto it = ground_cells.find(cell_key(cx, cy));
+				if (it == ground_cells.end()) {continue;}
+				for (int p : it->second) {
+					if ((cloud.x[p] >= min_x) && (cloud.x[p] <= max_x) && (cloud.y[p] >= min_y) && (cloud.y[p] <= max_y)) {points.push_back(p);}
+				}
+			}
+		}
+		ClusterStats stats;
+		stats.clear();
+		for (int i=0; i<points.size(); i++) {stats.add(cloud.z[points[i]]);}
+		ground_points += points.size();
+		ground_inputs.push_back(points);
+		ground_stats.push_back(stats);
+	}
+	start = chrono::steady_clock::now();
+	for (int c=0; c<ground_inputs.size(); c++) {
+		remove_ground_pts_from_cluster(cloud, ground_inputs[c], ground_stats[c], params.ground_z_band_fraction, params.ground_points_fraction);
+	}
+	results.push_back({"ground", num_points, ground_points, "points", seconds_since(start)});
+
+	// circles: random triples of points of the scene
+	CircleBatch batch;
+	mt19937 gen(scene.seed);
+	uniform_int_distribution<int> pick(0, cloud.size()-1);
+	long long num_circles = max(100000LL, (long long) cloud.size());
+	double circle_seconds = 0;
+	for (long long done=0; done<num_circles; done+=circle_batch_size) {
+		batch.size = circle_batch_size;
+		for (int i=0; i<batch.size; i++) {
+			int p0 = pick(gen), p1 = pick(gen), p2 = pick(gen);
+			batch.x0[i] = cloud.x[p0]; batch.y0[i] = cloud.y[p0];
+			batch.x1[i] = cloud.x[p1]; batch.y1[i] = cloud.y[p1];
+			batch.x2[i] = cloud.x[p2]; batch.y2[i] = cloud.y[p2];
+		}
+		start = chrono::steady_clock::now();
+		fit_circles(batch);
+		circle_seconds += seconds_since(start);
+	}
+	results.push_back({"circles", num_points, num_circles, "circles", circle_seconds});
+
+	// median & enclosure, on the clusters of relevant sizes
+	vector<IndexSpan> candidates;
+	long long candidate_points = 0;
+	for (int c=0; c<clusters.size(); c++) {
+		if ((clusters[c].size() >= params.cluster_size_low_threshold) && (clusters[c].size() <= params.cluster_size_high_threshold)) {
+			candidates.push_back(clusters[c]);
+			candidate_points += clusters[c].size();
+		}
+	}
+	vector<MedianCylinder> cylinders;
+	start = chrono::steady_clock::now();
+	find_median_radius_of_clusters(cloud, candidates, cylinders, params);
+	double median_seconds = seconds_since(start);
+	long long median_circles = 0;
+	for (int c=0; c<cylinders.size(); c++) {median_circles += cylinders[c].num_circles;}
+	results.push_back({"median", num_points, median_circles, "circles", median_seconds});
+
+	// algebraic circle fits (the other curvature engines), on the same clusters
+	vector<MedianCylinder> fits;
+	const char* fit_names[] = {"", "kasa", "pratt", "taubin"}; // (by circle_fit_*)
+	for (int method=circle_fit_kasa; method<=circle_fit_taubin; method++) {
+		SegmenterParams fit_params = params;
+		fit_params.circle_fit = method;
+		start = chrono::steady_clock::now();
+		find_median_radius_of_clusters(cloud, candidates, fits, fit_params);
+		results.push_back({fit_names[method], num_points, candidate_points, "points", seconds_since(start)});
+	}
+	SegmenterParams ransac_params = params;
+	ransac_params.circle_fit = circle_fit_taubin;
+	ransac_params.circle_fit_ransac_iterations = 100;
+	start = chrono::steady_clock::now();
+	find_median_radius_of_clusters(cloud, candidates, fits, ransac_params);
+	results.push_back({"ransac", num_points, candidate_points, "points", seconds_since(start)});
+
+	int enclosed = 0;
+	start = chrono::steady_clock::now();
+	for (int c=0; c<candidates.size(); c++) {
+		enclosed += check_if_cluster_resides_inside_median_cylinder(cloud, candidates[c], cylinders[c], params.cluster_enclosing_threshold);
+	}
+	results.push_back({"enclosure", num_points, candidate_points, "points", seconds_since(start)});
+
+	cout << "scene of " << num_points << " points: " << clusters.size() << " clusters, " << candidates.size() << " of relevant sizes, " << enclosed << " enclosed by their median cylinder" << endl;
+}
+
+int checks_failed = 0;
+
+void check(bool ok, const string& name, int num_points, const string& detail) {
+	cout << (ok ? "ok      " : "FAILED  ") << left << setw(20) << name << right << setw(10) << num_points << "  " << detail << endl;
+	if (!ok) {checks_failed++;}
+}
+
+void check_tiled_rejections(PointCloud& scene, SegmenterParams params) {
+	// Oversize clusters (facades) are rejected while they're grown, with the map in one tile & in tiles which cut across the blocks of the scene.
+	params.growth_size_limit = 300;
+	PointCloud sequential = scene, one_tile = scene, tiled = scene;
+	ClusterSet clusters;
+	Segmenter(params).form_clusters(sequential, clusters);
+	params.cluster_tile_size = 1e6;
+	Segmenter(params).form_clusters(one_tile, clusters);
+	int rejected = 0, differ = 0;
+	for (int i=0; i<scene.size(); i++) {
+		rejected += (sequential.label[i] == label_rejected);
+		differ += ((sequential.label[i] == label_rejected) != (one_tile.label[i] == label_rejected));
+	}
+	check((rejected > 0) && (differ == 0), "tiled_rejections", scene.size(), to_string(rejected)+" points rejected by sequential growth, "+to_string(differ)+" points rejected differently in a single tile");
+	params.cluster_tile_size = 15;
+	Segmenter segmenter(params);
+	segmenter.form_clusters(tiled, clusters);
+	int rejected_tiled = count(tiled.label.begin(), tiled.label.end(), label_rejected), in_clusters = 0;
+	for (int i=0; i<clusters.members.size(); i++) {in_clusters += (tiled.label[clusters.members[i]] == label_rejected);}
+	check((segmenter.metrics.clusters_stopped_oversize > 0) && (rejected_tiled >= segmenter.metrics.clusters_stopped_oversize*params.growth_size_limit) && (in_clusters == 0), "tiled_rejections", scene.size(), to_string(segmenter.metrics.clusters_stopped_oversize)+" clusters stopped in tiles, "+to_string(rejected_tiled)+" points rejected, "+to_string(in_clusters)+" of them in clusters");
+}
+
+// Growth attempt (seed) which claimed each point, from the trace of every step of growth.
+struct AttemptRecorder : ClusterTraceSink {
+	unordered_map<int, int> attempt_of;
+
+	void add(TraceRecordHeader header, PointCloud& cloud, const int* added, const int* removed) {
+		for (int i=0; i<header.num_added; i++) {attempt_of.emplace(added[i], header.attempt);}
+	}
+};
+
+void check_stopped_components(PointCloud& scene, SegmenterParams params) {
+	// The points of the clusters stopped at the size limit (& their flood fills) are put into a grid of cells of proximity_threshold, where the
+	// neighbors of every point of every cluster are looked for. A cluster grown before a stopped one may still be next to it (points ground
+	// removal shifts in a cluster aren't searched for neighbors), but no cluster grown after it: sequential growth is traced to know which
+	// was grown first. In tiles, no cluster is next to a stopped cluster across the border of their tiles.
+	params.growth_size_limit = 300;
+	float radius = params.proximity_threshold;
+	for (float tile_size : {0.0f, 15.0f}) {
+		params.cluster_tile_size = tile_size;
+		PointCloud cloud = scene;
+		ClusterSet clusters, stopped;
+		AttemptRecorder order;
+		Segmenter segmenter(params);
+		segmenter.stopped = &stopped;
+		if (tile_size == 0) {
+			segmenter.trace = &order;
+			segmenter.params.trace_level = trace_steps;
+		}
+		segmenter.form_clusters(cloud, clusters);
+		auto key = [&](int cx, int cy, int cz) {return (((long long) cx & 0x1FFFFF) << 42) | (((long long) cy & 0x1FFFFF) << 21) | ((long long) cz & 0x1FFFFF);};
+		auto tile_of = [&](int p) {return make_pair((int) floor(cloud.x[p]/tile_size), (int) floor(cloud.y[p]/tile_size));};
+		unordered_map<long long, vector<pair<int,int>>> cells; // (point, attempt of its stopped cluster)
+		for (int c=0; c<stopped.size(); c++) {
+			int attempt = INT_MAX;
+			for (int i=0; i<stopped[c].size(); i++) {
+				auto it = order.attempt_of.find(stopped[c][i]);
+				if (it != order.attempt_of.end()) {attempt = min(attempt, it->second);}
+			}
+			for (int i=0; i<stopped[c].size(); i++) {
+				int p = stopped[c][i];
+				cells[key(floor(cloud.x[p]/radius), floor(cloud.y[p]/radius), floor(cloud.z[p]/radius))].push_back({p, attempt});
+			}
+		}
+		int touching = 0;
+		for (int p : clusters.members) {
+			int cx = floor(cloud.x[p]/radius), cy = floor(cloud.y[p]/radius), cz = floor(cloud.z[p]/radius);
+			bool near = false;
+			for (int dx=-1; dx<=1; dx++) {
+				for (int dy=-1; dy<=1; dy++) {
+					for (int dz=-1; dz<=1; dz++) {
+						auto it = cells.find(key(cx+dx, cy+dy, cz+dz));
+						if (it == cells.end()) {continue;}
+						for (auto& q : it->second) {
+							if (distance_bw_points(cloud, p, q.first) > radius) {continue;}
+							if (tile_size == 0) {near = near || (order.attempt_of[p] > q.second);}
+							else {near = near || (tile_of(p) != tile_of(q.first));}
+						}
+					}
+				}
+			}
+			touching += near;
+		}
+		check((segmenter.metrics.clusters_stopped_oversize > 0) && (touching == 0), "stopped_components", scene.size(), string((tile_size > 0) ? "in tiles: " : "")+to_string(segmenter.metrics.clusters_stopped_oversize)+" clusters stopped, "+to_string(segmenter.metrics.points_flood_filled)+" points flood filled, "+to_string(touching)+" points of clusters next to them"+((tile_size > 0) ? " across borders" : " (grown after them)"));
+	}
+}
+
+// Points of each tree found by the whole algorithm (sorted), & the labels form_clusters gives the points (if `labels` isn't NULL).
+void find_trees(PointCloud cloud, SegmenterParams& params, vector<vector<int>>& trees, Metrics& metrics, vector<int>* labels = NULL) {
+	Segmenter segmenter(params);
+	ClusterSet clusters;
+	FilterResult result;
+	segmenter.form_clusters(cloud, clusters);
+	if (labels != NULL) {*labels = cloud.label;}
+	segmenter.filter_clusters(cloud, clusters, result);
+	trees.clear();
+	for (int t : result.trees) {
+		IndexSpan tree = clusters[result.candidates[t]];
+		trees.emplace_back(tree.first, tree.first+tree.size());
+		sort(trees.back().begin(), trees.back().end());
+	}
+	metrics = segmenter.metrics;
+}
+
+void check_tiled_border_trees(SceneParams& scene, SegmenterParams params) {
+	// Trees cut by the border of 2 tiles are found as single trees, with the points sequential growth finds for them, apart from differences
+	// of ground removal: points which ground removal removed in either run, & points in the bottom band of the tree which ground removal tests
+	// (pieces of a tree have their ground removed on their own, & clusters of ground next to the base of a tree are grown in a different order).
+	PointCloud cloud;
+	generate_border_scene(15, scene, cloud);
+	vector<vector<int>> sequential, tiled;
+	vector<int> sequential_labels, tiled_labels;
+	Metrics metrics;
+	find_trees(cloud, params, sequential, metrics, &sequential_labels);
+	params.cluster_tile_size = 15;
+	find_trees(cloud, params, tiled, metrics, &tiled_labels);
+	int matched = 0, smallest = INT_MAX, differing = 0;
+	for (auto& a : sequential) {
+		smallest = min(smallest, (int) a.size());
+		int best = -1, best_common = 0;
+		for (int t=0; t<tiled.size(); t++) { // (the tree in tiles with most points in common)
+			vector<int> common;
+			set_intersection(a.begin(), a.end(), tiled[t].begin(), tiled[t].end(), back_inserter(common));
+			if (common.size() > best_common) {
+				best = t;
+				best_common = common.size();
+			}
+		}
+		if (best == -1) {continue;}
+		float min_z = INFINITY, max_z = -INFINITY;
+		for (int p : a) {
+			min_z = min(min_z, cloud.z[p]);
+			max_z = max(max_z, cloud.z[p]);
+		}
+		float ground_z = min_z+params.ground_z_band_fraction*(max_z-min_z);
+		vector<int> only;
+		set_symmetric_difference(a.begin(), a.end(), tiled[best].begin(), tiled[best].end(), back_inserter(only));
+		int not_ground = 0;
+		for (int p : only) {not_ground += (sequential_labels[p] != -1) && (tiled_labels[p] != -1) && (cloud.z[p] > ground_z);}
+		matched += (not_ground == 0);
+		differing += only.size();
+	}
+	check((sequential.size() == 3) && (tiled.size() == 3) && (matched == 3), "tiled_border_trees", cloud.size(), to_string(sequential.size())+" trees by sequential growth, "+to_string(tiled.size())+" in tiles, "+to_string(matched)+" with the same points apart from ground removal ("+to_string(differing)+" points differ)");
+	// A limit on the size of clusters which the pieces of a tree are under (but not the whole tree) stops the trees in tiles too: no tree is larger than the limit.
+	params.growth_size_limit = (smallest == INT_MAX) ? 1 : 0.7*smallest;
+	find_trees(cloud, params, tiled, metrics);
+	int largest = 0;
+	for (auto& b : tiled) {largest = max(largest, (int) b.size());}
+	check((largest <= params.growth_size_limit) && (metrics.clusters_stopped_oversize >= 3), "tiled_border_limit", cloud.size(), "with a limit of "+to_string(params.growth_size_limit)+" points: "+to_string(metrics.clusters_stopped_oversize)+" clusters stopped in tiles, largest tree has "+to_string(largest)+" points");
+}
+
+void check_prefilters_keep_trees(PointCloud cloud, SegmenterParams params, int num_points) {
+	// Trees of the scene are found with the pre-filters disabled (the default), then each is given to the pre-filters.
+	Segmenter segmenter(params);
+	ClusterSet clusters;
+	FilterResult result;
+	segmenter.form_clusters(cloud, clusters);
+	segmenter.filter_clusters(cloud, clusters, result);
+	use_shape_prefilters(params);
+	int rejected = 0;
+	ClusterShape shape;
+	MedianCylinder no_cylinder = {};
+	for (int t : result.trees) {
+		IndexSpan tree = clusters[result.candidates[t]];
+		find_cluster_shape(cloud, tree, shape);
+		for (ClusterFilter& f : segmenter.filters) {
+			if (f.needs_shape && !f.needs_cylinder && f.rejects(cloud, tree, shape, no_cylinder, params)) {
+				rejected++;
+				break;
+			}
+		}
+	}
+	check(!result.trees.empty() && (rejected == 0), "prefilters_keep_trees", num_points, to_string(rejected)+" of "+to_string(result.trees.size())+" trees rejected by the pre-filters");
+}
+
+// Trees of `cloud` segmented tile by tile, each tile with the points of its halo (as by `./code --stream`): tree of each point given by the
+// merger (points given more than once are counted in `duplicates`).
+void stream_trees(PointCloud& cloud, SegmenterParams& params, float tile_size, float halo, map<int, long long>& tree_of, int& duplicates) {
+	map<pair<int,int>, vector<int>> tiles; // (row, column) -> points of the tile & its halo
+	for (int p=0; p<cloud.size(); p++) {
+		for (int ty=floor((cloud.y[p]-halo)/tile_size); ty<=floor((cloud.y[p]+halo)/tile_size); ty++) {
+			for (int tx=floor((cloud.x[p]-halo)/tile_size); tx<=floor((cloud.x[p]+halo)/tile_size); tx++) {tiles[{ty, tx}].push_back(p);}
+		}
+	}
+	TileTreeMerger merger(tile_size, halo);
+	vector<pair<int,long long>> points;
+	tree_of.clear();
+	duplicates = 0;
+	for (auto& t : tiles) {
+		PointCloud tile;
+		for (int p : t.second) {tile.push_back(cloud.x[p], cloud.y[p], cloud.z[p], p);}
+		Segmenter segmenter(params);
+		ClusterSet clusters;
+		FilterResult result;
+		segmenter.form_clusters(tile, clusters);
+		segmenter.filter_clusters(tile, clusters, result);
+		merger.add_tile(t.first.second, t.first.first, tile, clusters, result, points);
+		for (auto& pt : points) {
+			duplicates += tree_of.count(tile.index[pt.first]);
+			tree_of[tile.index[pt.first]] = pt.second;
+		}
+	}
+}
+
+void check_stream_border_trees(SceneParams& scene, SegmenterParams params) {
+	PointCloud cloud;
+	generate_border_scene(15, scene, cloud);
+	vector<vector<int>> whole;
+	Metrics metrics;
+	find_trees(cloud, params, whole, metrics);
+	map<int, long long> tree_of;
+	int duplicates;
+	// halo covering the trees: every tile sees the whole trees around its border, so the trees are exactly those of the whole map
+	stream_trees(cloud, params, 15, params.proximity_threshold+2*params.tree_radius_thresh, tree_of, duplicates);
+	map<long long, vector<int>> streamed;
+	for (auto& pt : tree_of) {streamed[pt.second].push_back(pt.first);}
+	int matched = 0;
+	for (auto& a : whole) {
+		for (auto& b : streamed) {matched += (a == b.second);}
+	}
+	check((whole.size() >= 3) && (streamed.size() == whole.size()) && (matched == whole.size()) && (duplicates == 0), "stream_border_trees", cloud.size(), to_string(whole.size())+" trees in the whole map, "+to_string(streamed.size())+" streamed, "+to_string(matched)+" identical, "+to_string(duplicates)+" points given twice");
+	// halo narrower than the crowns: tiles see different pieces of the trees
+	stream_trees(cloud, params, 15, 1, tree_of, duplicates);
+	streamed.clear();
+	for (auto& pt : tree_of) {streamed[pt.second].push_back(pt.first);}
+	check(duplicates == 0, "stream_border_trees", cloud.size(), "with a halo of 1 m: "+to_string(streamed.size())+" trees streamed ("+to_string(tree_of.size())+" points), "+to_string(duplicates)+" points given twice");
+}
+
+void check_scene(int num_points, SceneParams& scene) {
+	PointCloud cloud;
+	generate_scene(num_points, scene, cloud);
+	SegmenterParams params;
+	params.rng_seed = scene.seed;
+	params.num_threads = 1;
+	params.combinations_threshold = 100000;
+	check_tiled_rejections(cloud, params);
+	check_stopped_components(cloud, params);
+	check_prefilters_keep_trees(cloud, params, cloud.size());
+}
+
+void print_results(vector<StageResult>& results, ostream& out, bool csv) {
+	// Prints throughput of every stage at every size & the scaling exponent w.r.t. the previous size of the same stage (1: linear).
+	if (csv) {
+		out << "stage,scene_points,work,unit,seconds,throughput_per_s,scaling_exponent" << endl;
+	} else {
+		out << left << setw(10) << "stage" << right << setw(12) << "points" << setw(14) << "work" << setw(10) << "" << setw(12) << "time(ms)" << setw(16) << "throughput/s" << setw(10) << "scaling" << endl;
+	}
+	for (int i=0; i<results.size(); i++) {
+		StageResult& r = results[i];
+		double throughput = (r.seconds > 0) ? r.work/r.seconds : 0;
+		string scaling = "";
+		for (int j=i-1; j>=0; j--) {
+			if (results[j].stage != r.stage) {continue;}
+			if ((results[j].seconds > 0) && (r.seconds > 0) && (r.num_points != results[j].num_points)) {
+				ostringstream s;
+				s << fixed << setprecision(2) << log(r.seconds/results[j].seconds)/log((double) r.num_points/results[j].num_points);
+				scaling = s.str();
+			}
+			break;
+		}
+		if (csv) {
+			out << r.stage << ',' << r.num_points << ',' << r.work << ',' << r.unit << ',' << r.seconds << ',' << throughput << ',' << scaling << endl;
+		} else {
+			out << left << setw(10) << r.stage << right << setw(12) << r.num_points << setw(14) << r.work << setw(10) << r.unit << setw(12) << fixed << setprecision(2) << r.seconds*1000 << setw(16) << setprecision(0) << throughput << setw(10) << scaling << endl;
+		}
+	}
+}
+
+void print_thread_scaling(vector<StageResult>& results, ostream& out) {
+	// Prints the speedup of tiled growth on T threads over 1 thread at every size (& its efficiency: speedup/T, 1 if it scales linearly).
+	out << left << setw(10) << "stage" << right << setw(12) << "points" << setw(12) << "time(ms)" << setw(10) << "speedup" << setw(12) << "efficiency" << endl;
+	for (StageResult& r : results) {
+		if (r.stage.compare(0, 6, "tiled/") != 0) {continue;}
+		int num_threads = stoi(r.stage.substr(6));
+		for (StageResult& one : results) {
+			if ((one.stage != "tiled/1") || (one.num_points != r.num_points) || (r.seconds <= 0)) {continue;}
+			double speedup = one.seconds/r.seconds;
+			out << left << setw(10) << r.stage << right << setw(12) << r.num_points << setw(12) << fixed << setprecision(2) << r.seconds*1000 << setw(10) << speedup << setw(12) << speedup/num_threads << endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	vector<int> sizes = {10000, 100000, 1000000, 10000000};
+	SceneParams scene;
+	int combinations = 100000;
+	string csv_path;
+	bool run_checks = false;
+	for (int i=1; i<argc; i++) {
+		string opt = argv[i];
+		if ((opt == "--sizes") && (i+1 < argc)) {
+			sizes.clear();
+			stringstream list(argv[++i]);
+			string size;
+			while (getline(list, size, ',')) {sizes.push_back(stoi(size));}
+		} else if ((opt == "--density") && (i+1 < argc)) {
+			scene.density = stof(argv[++i]);
+		} else if ((opt == "--combinations") && (i+1 < argc)) {
+			combinations = stoi(argv[++i]);
+		} else if ((opt == "--seed") && (i+1 < argc)) {
+			scene.seed = stoul(argv[++i]);
+		} else if ((opt == "--csv") && (i+1 < argc)) {
+			csv_path = argv[++i];
+		} else if (opt == "--check") {
+			run_checks = true;
+			if (find(argv+1, argv+argc, string("--sizes")) == argv+argc) {sizes = {10000, 100000};}
+		} else {
+			cout << "Usage: ./treeseg_bench [--sizes 10000,100000,1000000,10000000] [--density D] [--combinations C] [--seed S] [--csv file] [--check]" << endl;
+			exit(1);
+		}
+	}
+	if (run_checks) {
+		for (int i=0; i<sizes.size(); i++) {
+			check_scene(sizes[i], scene);
+		}
+		SegmenterParams params;
+		params.rng_seed = scene.seed;
+		params.num_threads = 1;
+		check_tiled_border_trees(scene, params);
+		check_stream_border_trees(scene, params);
+		cout << ((checks_failed == 0) ? "All checks passed" : to_string(checks_failed)+" checks failed") << endl;
+		return (checks_failed == 0) ? 0 : 1;
+	}
+	vector<StageResult> results;
+	for (int i=0; i<sizes.size(); i++) {
+		bench_scene(sizes[i], scene, combinations, results);
+	}
+	stable_sort(results.begin(), results.end(), [](const StageResult& a, const StageResult& b) {return a.stage < b.stage;}); // group by stage (sizes stay in the order they were run)
+	cout << endl;
+	print_results(results, cout, false);
+	cout << endl;
+	print_thread_scaling(results, cout);
+	if (!csv_path.empty()) {
+		ofstream csv(csv_path);
+		print_results(results, csv, true);
+	}
+	return 0;
+}
@@ -0,0 +1,91 @@
+// Evaluation of the output of the algorithm against the ground truth of the Oakland dataset (same accuracies as evaluate.py, in linear time).
+// The ground truth of a map is confidence_files/oakland_part<map>_conf.txt & the final output is wrl_files/AlgoOutput/tree_<map>_final.wrl.
+// Each map is scored in one pass over each of the two files (see treeseg_score.h). All maps are scored in parallel.
+// Usage: make && ./treeseg_eval [--conf-dir D] [--pred-dir D] [--threads N] [--confusion] [map ...]
+// 		maps: names of the maps to score (default: all 17 maps scored by evaluate.py)
+// 		--conf-dir: directory of the confidence files (default: confidence_files)
+// 		--pred-dir: directory of the final output of the algorithm (default: wrl_files/AlgoOutput)
+// 		--threads: number of maps scored at once (default: number of hardware threads)
+// 		--confusion: also print the confusion matrix (tree vs not a tree) & the predictions for each class of the ground truth
+
+#include <bits/stdc++.h>
+#include "treeseg_score.h"
+
+using namespace std;
+
+struct MapResult {
+	string name;
+	string error; // empty if the map was scored
+	MapScore score;
+};
+
+void score_map(string& conf_dir, string& pred_dir, MapResult& result) {
+	CentiPointSet pred;
+	GroundTruth truth;
+	if (!read_predicted_points(pred_dir+"/tree_"+result.name+"_final.wrl", pred, result.error)) {return;}
+	if (!read_ground_truth(conf_dir+"/oakland_part"+result.name+"_conf.txt", truth, result.error)) {return;}
+	score_points(truth, pred, result.score);
+}
+
+void print_confusion(const MapScore& score) {
+	cout << "  " << left << setw(20) << "actual \\ predicted" << right << setw(12) << "tree" << setw(12) << "not tree" << endl;
+	cout << "  " << left << setw(20) << "tree" << right << setw(12) << score.true_pos << setw(12) << score.false_neg << endl;
+	cout << "  " << left << setw(20) << "not tree" << right << setw(12) << score.false_pos << setw(12) << score.true_neg << endl;
+	cout << "  " << left << setw(8) << "label" << setw(24) << "class" << right << setw(10) << "points" << setw(12) << "as tree" << endl;
+	for (auto& c : score.classes) {
+		if (c.second.points == 0) {continue;}
+		cout << "  " << left << setw(8) << c.first << setw(24) << c.second.name << right << setw(10) << c.second.points << setw(12) << c.second.predicted << endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	string conf_dir = "confidence_files", pred_dir = "wrl_files/AlgoOutput";
+	int num_threads = 0;
+	bool confusion = false;
+	vector<string> maps;
+	for (int i=1; i<argc; i++) {
+		string opt = argv[i];
+		if ((opt == "--conf-dir") && (i+1 < argc)) {
+			conf_dir = argv[++i];
+		} else if ((opt == "--pred-dir") && (i+1 < argc)) {
+			pred_dir = argv[++i];
+		} else if ((opt == "--threads") && (i+1 < argc)) {
+			num_threads = stoi(argv[++i]);
+		} else if (opt == "--confusion") {
+			confusion = true;
+		} else if ((opt.size() > 0) && (opt[0] != '-')) {
+			maps.push_back(opt);
+		} else {
+			cout << "Usage: ./treeseg_eval [--conf-dir D] [--pred-dir D] [--threads N] [--confusion] [map ...]" << endl;
+			exit(1);
+		}
+	}
+	if (maps.empty()) {maps = {"2_ac", "2_ad", "2_ae", "2_ag", "2_ah", "2_ai", "2_aj", "2_ak", "2_al", "2_ao", "3_aj", "3_ak", "3_al", "3_am", "3_an", "3_ao", "3_ap"};}
+	if (num_threads <= 0) {num_threads = max(1u, thread::hardware_concurrency());}
+	num_threads = min(num_threads, (int) maps.size());
+
+	vector<MapResult> results(maps.size());
+	for (int m=0; m<maps.size(); m++) {results[m].name = maps[m];}
+	atomic<int> next(0);
+	vector<thread> workers;
+	for (int t=0; t<num_threads; t++) {
+		workers.emplace_back([&]() {
+			for (int m=next++; m<results.size(); m=next++) {score_map(conf_dir, pred_dir, results[m]);}
+		});
+	}
+	for (int t=0; t<workers.size(); t++) {workers[t].join();}
+
+	int failed = 0;
+	for (int m=0; m<results.size(); m++) {
+		cout << "\n**************" << endl;
+		cout << results[m].name << endl;
+		if (!results[m].error.empty()) {
+			cout << "Error: " << results[m].error << endl;
+			failed++;
+			continue;
+		}
+		cout << "Accuracy:  " << results[m].score.accuracy_str() << endl;
+		if (confusion) {print_confusion(results[m].score);}
+	}
+	return (failed > 0) ? 1 : 0;
+}
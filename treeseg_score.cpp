@@ -0,0 +1,193 @@
+// treeseg_score: scoring against the ground truth (see treeseg_score.h).
+
+#include "treeseg_score.h"
+#include <bits/stdc++.h>
+
+using namespace std;
+
+const int req_classes[] = {1300, 1302, 1303, 1304, 1305}; // IDs for classes foliage, small_trunk, large_trunk, thin_branch, thick_branch
+
+bool is_tree_class(int label) {
+	return find(begin(req_classes), end(req_classes), label) != end(req_classes);
+}
+
+long long round_to_centi(double v) {
+	return (long long) nearbyint(v*100);
+}
+
+string python_str(long long c) {
+	// Shortest digits which read back as the same double, with ".0" if there are no decimals.
+	// (Python switches to exponents below 1e-4 & from 1e16, which a coordinate rounded to centimeters never is.)
+	char buf[64];
+	auto res = to_chars(buf, buf+sizeof(buf), c/100.0, chars_format::fixed);
+	string s(buf, res.ptr);
+	if (s.find('.') == string::npos) {s += ".0";}
+	return s;
+}
+
+bool parse_double(string_view s, double& v) {
+	auto res = from_chars(s.data(), s.data()+s.size(), v);
+	return (res.ec == errc()) && (res.ptr == s.data()+s.size()) && (s.size() > 0);
+}
+
+long long wrl_centi(float v) {
+	char buf[64];
+	auto res = to_chars(buf, buf+sizeof(buf), (double) v, chars_format::fixed, 6);
+	double d;
+	parse_double(string_view(buf, res.ptr-buf), d);
+	return round_to_centi(d);
+}
+
+double MapScore::accuracy() const {
+	return round_to_centi(100*(double) correct/(correct+wrong))/100.0;
+}
+
+string MapScore::accuracy_str() const {
+	return python_str(round_to_centi(100*(double) correct/(correct+wrong)));
+}
+
+bool read_file(const string& path, string& contents) {
+	ifstream in(path, ios::binary);
+	if (!in) {return false;}
+	ostringstream s;
+	s << in.rdbuf();
+	contents = s.str();
+	return true;
+}
+
+// Calls f(line) for every line of `text`, without leading & trailing whitespace (as python's strip). Stops when f returns false.
+template<class F> void for_each_line(const string& text, F f) {
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t end = text.find('\n', pos);
+		if (end == string::npos) {end = text.size();}
+		size_t b = pos, e = end;
+		while ((b < e) && isspace((unsigned char) text[b])) {b++;}
+		while ((e > b) && isspace((unsigned char) text[e-1])) {e--;}
+		if (!f(string_view(text.data()+b, e-b))) {return;}
+		pos = end+1;
+	}
+}
+
+// Tokens of `line` separated by single spaces (as python's split(' '), i.e. consecutive spaces give empty tokens).
+void split_spaces(string_view line, vector<string_view>& tokens) {
+	tokens.clear();
+	size_t pos = 0;
+	while (true) {
+		size_t end = line.find(' ', pos);
+		if (end == string_view::npos) {
+			tokens.push_back(line.substr(pos));
+			return;
+		}
+		tokens.push_back(line.substr(pos, end-pos));
+		pos = end+1;
+	}
+}
+
+bool parse_int(string_view s, int& v) {
+	auto res = from_chars(s.data(), s.data()+s.size(), v);
+	return (res.ec == errc()) && (res.ptr == s.data()+s.size());
+}
+
+// Coordinate of a point of the ground truth in centimeters, if it's written the way python prints a rounded float.
+bool ground_truth_centi(string_view token, double v, long long& c) {
+	if (!isfinite(v)) {return false;}
+	c = round_to_centi(v);
+	return python_str(c) == token;
+}
+
+bool read_ground_truth(const string& path, GroundTruth& truth, string& error) {
+	string text;
+	error.clear();
+	if (!read_file(path, text)) {
+		error = "can't read "+path;
+		return false;
+	}
+	truth = GroundTruth();
+	vector<string_view> tokens;
+	for_each_line(text, [&](string_view line) {
+		if (line.empty()) {return true;}
+		if (line[0] == '#') { // header, which also names the classes: "#  1300 -- foliage"
+			split_spaces(line, tokens);
+			int label;
+			if ((tokens.size() == 5) && (tokens[3] == "--") && parse_int(tokens[2], label)) {truth.class_names[label] = string(tokens[4]);}
+			return true;
+		}
+		split_spaces(line, tokens);
+		double v[3];
+		int label;
+		if ((tokens.size() < 4) || !parse_int(tokens[tokens.size()-2], label) || !parse_double(tokens[0], v[0]) || !parse_double(tokens[1], v[1]) || !parse_double(tokens[2], v[2])) {
+			error = "bad point in "+path+": "+string(line);
+			return false;
+		}
+		CentiPoint p;
+		bool matchable = ground_truth_centi(tokens[0], v[0], p.x) && ground_truth_centi(tokens[1], v[1], p.y) && ground_truth_centi(tokens[2], v[2], p.z);
+		float f[3];
+		for (int k=0; k<3; k++) {from_chars(tokens[k].data(), tokens[k].data()+tokens[k].size(), f[k]);}
+		truth.x.push_back(f[0]);
+		truth.y.push_back(f[1]);
+		truth.z.push_back(f[2]);
+		truth.keys.push_back(p);
+		truth.matchable.push_back(matchable);
+		truth.labels.push_back(label);
+		return true;
+	});
+	if (error.empty() && truth.labels.empty()) {error = "no points in "+path;}
+	return error.empty();
+}
+
+bool read_predicted_points(const string& path, CentiPointSet& pred, string& error) {
+	string text;
+	error.clear();
+	if (!read_file(path, text)) {
+		error = "can't read "+path;
+		return false;
+	}
+	pred.reserve(text.size()/32);
+	vector<string_view> tokens;
+	bool in_points = false;
+	for_each_line(text, [&](string_view line) {
+		if (line == "point [") {
+			in_points = true;
+			return true;
+		}
+		if (!in_points) {return true;}
+		if (line == "0 0 0 ]") {return false;}
+		if (line == "0.000000 0.000000 0.000000,") {return true;}
+		split_spaces(line, tokens);
+		double x, y, z;
+		string_view last = (tokens.size() > 2) ? tokens[2].substr(0, tokens[2].find(',')) : string_view();
+		if ((tokens.size() < 3) || !parse_double(tokens[0], x) || !parse_double(tokens[1], y) || !parse_double(last, z)) {
+			error = "bad point in "+path+": "+string(line);
+			return false;
+		}
+		pred.insert({round_to_centi(x), round_to_centi(y), round_to_centi(z)});
+		return true;
+	});
+	return error.empty();
+}
+
+void score_predictions(const GroundTruth& truth, const vector<char>& predicted, MapScore& score) {
+	score = MapScore();
+	for (auto& c : truth.class_names) {score.classes[c.first].name = c.second;}
+	for (int i=0; i<truth.size(); i++) {
+		bool tree = is_tree_class(truth.labels[i]);
+		if (tree == (bool) predicted[i]) {score.correct++;} else {score.wrong++;}
+		if (tree) {
+			if (predicted[i]) {score.true_pos++;} else {score.false_neg++;}
+		} else {
+			if (predicted[i]) {score.false_pos++;} else {score.true_neg++;}
+		}
+		ClassCounts& counts = score.classes[truth.labels[i]];
+		counts.points++;
+		counts.predicted += predicted[i];
+	}
+}
+
+void score_points(const GroundTruth& truth, const CentiPointSet& pred, MapScore& score) {
+	vector<char> predicted(truth.size());
+	for (int i=0; i<truth.size(); i++) {
+		predicted[i] = truth.matchable[i] && pred.count(truth.keys[i]);
+	}
+	score_predictions(truth, predicted, score);
+}
@@ -0,0 +1,80 @@
+// Scoring of the output of the algorithm against the ground truth of the Oakland dataset, with the semantics of evaluate.py (in linear time).
+// A point of the ground truth (confidence file: lines "x y z label_id confidence") is predicted as a tree if its coordinates are among the
+// predicted points, rounded to 2 decimals. Points of classes foliage, small_trunk, large_trunk, thin_branch & thick_branch are trees.
+// Accuracy is the percentage of points predicted correctly (tree or not).
+// evaluate.py compares every point of the ground truth with the list of all predicted points, as strings. Here, predicted points are rounded
+// to integer centimeters (exactly like numpy's around) & put into a hash set. A point of the ground truth is looked up only if its coordinates
+// are written exactly the way python prints a rounded float (else, evaluate.py wouldn't find it either).
+// Used by treeseg_eval (scores wrl files) & treeseg_sweep (scores segmentations in memory).
+
+#ifndef TREESEG_SCORE_H
+#define TREESEG_SCORE_H
+
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct CentiPoint { // coordinates, rounded to integer centimeters
+	long long x, y, z;
+	bool operator==(const CentiPoint& o) const {return (x == o.x) && (y == o.y) && (z == o.z);}
+};
+
+struct CentiPointHash {
+	size_t operator()(const CentiPoint& p) const {
+		unsigned long long h = p.x*0x9E3779B97F4A7C15ULL;
+		h = (h ^ (h >> 29) ^ (unsigned long long) p.y)*0xBF58476D1CE4E5B9ULL;
+		h = (h ^ (h >> 32) ^ (unsigned long long) p.z)*0x94D049BB133111EBULL;
+		return h ^ (h >> 31);
+	}
+};
+
+typedef std::unordered_set<CentiPoint, CentiPointHash> CentiPointSet;
+
+// Points of a confidence file, in the order of the file (which is also the order of the points in the map).
+struct GroundTruth {
+	std::vector<float> x, y, z; // coordinates read as floats (like the map is read by the algorithm)
+	std::vector<CentiPoint> keys; // coordinates in centimeters
+	std::vector<char> matchable; // 0 if the coordinates aren't written the way python prints a rounded float (evaluate.py never finds such a point)
+	std::vector<int> labels; // label_id of each point
+	std::map<int, std::string> class_names; // label_id -> name of the class (from the header of the file)
+
+	int size() const {
+		return labels.size();
+	}
+};
+
+struct ClassCounts {
+	std::string name;
+	long long points = 0;
+	long long predicted = 0; // points predicted as a tree
+};
+
+struct MapScore {
+	long long correct = 0, wrong = 0;
+	long long true_pos = 0, false_neg = 0, false_pos = 0, true_neg = 0; // tree vs not a tree
+	std::map<int, ClassCounts> classes; // by label_id of the ground truth
+
+	double accuracy() const; // percentage, rounded to 2 decimals (like evaluate.py)
+	std::string accuracy_str() const; // the accuracy as evaluate.py prints it
+};
+
+bool is_tree_class(int label);
+// numpy's around(v, 2), in integer centimeters: v*100 rounded half to even.
+long long round_to_centi(double v);
+// How python prints the float c/100.
+std::string python_str(long long c);
+// A coordinate of a point of the algorithm in centimeters, as written into an output wrl ("%f") & rounded by evaluate.py.
+long long wrl_centi(float v);
+
+// Each returns false (& sets `error`) if the file can't be read or has a malformed line.
+bool read_ground_truth(const std::string& path, GroundTruth& truth, std::string& error);
+// Points of the list of points of an output wrl file (except the points at the origin written for empty files).
+bool read_predicted_points(const std::string& path, CentiPointSet& pred, std::string& error);
+
+// Scores the ground truth against a set of predicted points.
+void score_points(const GroundTruth& truth, const CentiPointSet& pred, MapScore& score);
+// Scores the ground truth, given for each of its points whether it's predicted as a tree.
+void score_predictions(const GroundTruth& truth, const std::vector<char>& predicted, MapScore& score);
+
+#endif
@@ -0,0 +1,313 @@
+// Sweep of the hyper-parameters of the segmentation algorithm (treeseg.h) over a grid of values, scored against the ground truth (see treeseg_score.h).
+// The points of a map are read from its confidence file (confidence_files/oakland_part<map>_conf.txt lists all points of the map, in order).
+// Every combination of the grid is scored, but each expensive intermediate is computed once per distinct value of the parameters it depends on:
+// 	clusters: once per (proximity_threshold, cluster_z_range_fraction, ground_z_band_fraction, ground_points_fraction, growth_size_limit, cluster_tile_size, downsample_voxel, ground_cell_size, ground_band)
+// 	median cylinders: once per cluster (of any size within the size thresholds of the grid), per (combinations_threshold, xy_dedup_epsilon, circle_fit, circle_fit_ransac_*)
+// 	filters: size, pre-filter, radius & enclosure thresholds are re-evaluated in memory for every combination (the number of points of each cluster
+// 		inside its median cylinder & its shape are found once, so each filter is a comparison per cluster).
+// Combinations are drawn with a fixed seed (`--seed`, default 1), so a combination gets exactly the trees a run of the algorithm with those values gets.
+// Usage: make sweep && ./treeseg_sweep [name=v1,v2,...]... [--maps 2_ac,3_ap,...] [--seed S] [--threads N] [--conf-dir D] [--csv file]
+// 		name: one of the hyper-parameters of SegmenterParams listed in `sweep_params` below, e.g. proximity_threshold=0.5,0.7 tree_radius_thresh=4,6,8
+// 			(parameters which aren't given keep their default value)
+// 		--maps: maps to run on (default: all 17 maps scored by evaluate.py)
+// 		--threads: number of threads used to find median cylinders (default: all cores)
+// 		--csv: also write accuracy & runtime of every combination on every map into a csv file
+// Output: a table with a row per combination: values of the swept parameters, mean accuracy over the maps, number of trees & the time a run
+// of the combination would take (clustering + median cylinders + filters, as measured when they were computed for the sweep).
+
+#include <bits/stdc++.h>
+#include "treeseg.h"
+#include "treeseg_score.h"
+
+using namespace std;
+
+// Stage of the algorithm a parameter is used in (intermediates of a stage depend on the parameters of its stage & of the stages before it).
+const int level_clusters = 0, level_cylinders = 1, level_filters = 2;
+
+struct SweepParam {
+	string name;
+	int level;
+	function<void(SegmenterParams&, double)> set;
+};
+
+const vector<SweepParam> sweep_params = {
+	{"proximity_threshold", level_clusters, [](SegmenterParams& p, double v) {p.proximity_threshold = v;}},
+	{"cluster_z_range_fraction", level_clusters, [](SegmenterParams& p, double v) {p.cluster_z_range_fraction = v;}},
+	{"ground_z_band_fraction", level_clusters, [](SegmenterParams& p, double v) {p.ground_z_band_fraction = v;}},
+	{"ground_points_fraction", level_clusters, [](SegmenterParams& p, double v) {p.ground_points_fraction = v;}},
+	{"growth_size_limit", level_clusters, [](SegmenterParams& p, double v) {p.growth_size_limit = v;}},
+	{"cluster_tile_size", level_clusters, [](SegmenterParams& p, double v) {p.cluster_tile_size = v;}},
+	{"downsample_voxel", level_clusters, [](SegmenterParams& p, double v) {p.downsample_voxel = v;}},
+	{"ground_cell_size", level_clusters, [](SegmenterParams& p, double v) {p.ground_cell_size = v;}},
+	{"ground_band", level_clusters, [](SegmenterParams& p, double v) {p.ground_band = v;}},
+	{"combinations_threshold", level_cylinders, [](SegmenterParams& p, double v) {p.combinations_threshold = v;}},
+	{"xy_dedup_epsilon", level_cylinders, [](SegmenterParams& p, double v) {p.xy_dedup_epsilon = v;}},
+	{"circle_fit", level_cylinders, [](SegmenterParams& p, double v) {p.circle_fit = v;}},
+	{"circle_fit_ransac_iterations", level_cylinders, [](SegmenterParams& p, double v) {p.circle_fit_ransac_iterations = v;}},
+	{"circle_fit_ransac_tolerance", level_cylinders, [](SegmenterParams& p, double v) {p.circle_fit_ransac_tolerance = v;}},
+	{"cluster_size_low_threshold", level_filters, [](SegmenterParams& p, double v) {p.cluster_size_low_threshold = v;}},
+	{"cluster_size_high_threshold", level_filters, [](SegmenterParams& p, double v) {p.cluster_size_high_threshold = v;}},
+	{"tree_radius_thresh", level_filters, [](SegmenterParams& p, double v) {p.tree_radius_thresh = v;}},
+	{"cluster_enclosing_threshold", level_filters, [](SegmenterParams& p, double v) {p.cluster_enclosing_threshold = v;}},
+	{"max_xy_aspect", level_filters, [](SegmenterParams& p, double v) {p.max_xy_aspect = v;}},
+	{"max_planarity", level_filters, [](SegmenterParams& p, double v) {p.max_planarity = v;}},
+	{"max_linearity", level_filters, [](SegmenterParams& p, double v) {p.max_linearity = v;}},
+	{"min_height_to_footprint", level_filters, [](SegmenterParams& p, double v) {p.min_height_to_footprint = v;}},
+};
+
+struct GridAxis {
+	const SweepParam* param;
+	vector<double> values;
+	vector<string> texts; // values as given on the command line
+};
+
+// A combination of the grid is a value index per axis. Axes are sorted by level, so combinations sharing their clusters (or cylinders) are consecutive.
+struct Combination {
+	vector<int> value_idx;
+	SegmenterParams params;
+	int cluster_group; // combinations with the same clustering parameters share a group (numbered in order)
+	int cylinder_group; // same for clustering & cylinder parameters
+};
+
+struct ComboResult {
+	double accuracy = 0;
+	int trees = 0;
+	double cluster_seconds = 0, cylinder_seconds = 0, filter_seconds = 0;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
+
+void build_combinations(vector<GridAxis>& axes, SegmenterParams& base, vector<Combination>& combos) {
+	vector<int> idx(axes.size(), 0);
+	int cluster_group = -1, cylinder_group = -1;
+	vector<int> prev;
+	while (true) {
+		Combination c;
+		c.value_idx = idx;
+		c.params = base;
+		bool new_clusters = prev.empty(), new_cylinders = prev.empty();
+		for (int a=0; a<axes.size(); a++) {
+			axes[a].param->set(c.params, axes[a].values[idx[a]]);
+			if (!prev.empty() && (prev[a] != idx[a])) {
+				if (axes[a].param->level <= level_clusters) {new_clusters = true;}
+				if (axes[a].param->level <= level_cylinders) {new_cylinders = true;}
+			}
+		}
+		cluster_group += new_clusters;
+		cylinder_group += new_cylinders;
+		c.cluster_group = cluster_group;
+		c.cylinder_group = cylinder_group;
+		combos.push_back(c);
+		prev = idx;
+		int a = axes.size()-1; // next combination (last axis changes fastest)
+		while ((a >= 0) && (++idx[a] == axes[a].values.size())) {idx[a--] = 0;}
+		if (a < 0) {break;}
+	}
+}
+
+// Runs all combinations on one map & adds their results (per combination) to `results`.
+void sweep_map(GroundTruth& truth, vector<Combination>& combos, vector<ComboResult>& results) {
+	PointCloud cloud;
+	cloud.reserve(truth.size());
+	for (int i=0; i<truth.size(); i++) {
+		cloud.push_back(truth.x[i], truth.y[i], truth.z[i], i);
+	}
+	// Points of the map & of the ground truth which evaluate.py matches with each other share an id (coordinates in centimeters, as in an output wrl).
+	unordered_map<CentiPoint, int, CentiPointHash> key_ids;
+	vector<int> point_key(cloud.size()), truth_key(truth.size(), -1);
+	for (int p=0; p<cloud.size(); p++) {
+		CentiPoint k = {wrl_centi(cloud.x[p]), wrl_centi(cloud.y[p]), wrl_centi(cloud.z[p])};
+		point_key[p] = key_ids.emplace(k, key_ids.size()).first->second;
+	}
+	for (int i=0; i<truth.size(); i++) {
+		auto it = key_ids.find(truth.keys[i]);
+		if (truth.matchable[i] && (it != key_ids.end())) {truth_key[i] = it->second;}
+	}
+	int low = INT_MAX, high = 0; // widest range of sizes of the clusters which can pass the 1st stage of filtering
+	for (int c=0; c<combos.size(); c++) {
+		low = min(low, combos[c].params.cluster_size_low_threshold);
+		high = max(high, combos[c].params.cluster_size_high_threshold);
+	}
+
+	ClusterSet clusters;
+	vector<int> candidates; // clusters within [low, high]
+	vector<IndexSpan> candidate_spans;
+	vector<MedianCylinder> cylinders;
+	vector<int> enclosed; // points of each candidate inside its median cylinder
+	vector<ClusterShape> shapes; // shape of each candidate (for the pre-filters)
+	vector<ClusterFilter> prefilters; // filters on the shape of a cluster (the size, radius & enclosure filters are comparisons with the values above)
+	for (ClusterFilter& f : default_cluster_filters()) {
+		if (f.needs_shape && !f.needs_cylinder) {prefilters.push_back(f);}
+	}
+	vector<char> key_predicted(key_ids.size()), predicted(truth.size());
+	double cluster_seconds = 0, cylinder_seconds = 0;
+	for (int c=0; c<combos.size(); c++) {
+		SegmenterParams& params = combos[c].params;
+		if ((c == 0) || (combos[c].cluster_group != combos[c-1].cluster_group)) {
+			auto start = chrono::steady_clock::now();
+			fill(cloud.label.begin(), cloud.label.end(), -1);
+			Segmenter segmenter(params);
+			segmenter.form_clusters(cloud, clusters);
+			cluster_seconds = seconds_since(start);
+		}
+		if ((c == 0) || (combos[c].cylinder_group != combos[c-1].cylinder_group)) {
+			auto start = chrono::steady_clock::now();
+			candidates.clear();
+			candidate_spans.clear();
+			for (int k=0; k<clusters.size(); k++) {
+				if ((clusters[k].size() >= low) && (clusters[k].size() <= high)) {
+					candidates.push_back(k);
+					candidate_spans.push_back(clusters[k]);
+				}
+			}
+			find_median_radius_of_clusters(cloud, candidate_spans, cylinders, params, &candidates);
+			enclosed.resize(candidates.size());
+			shapes.resize(candidates.size());
+			for (int k=0; k<candidates.size(); k++) {
+				enclosed[k] = count_points_inside_median_cylinder(cloud, candidate_spans[k], cylinders[k]);
+				find_cluster_shape(cloud, candidate_spans[k], shapes[k]);
+			}
+			cylinder_seconds = seconds_since(start);
+		}
+		// filters (as in Segmenter::filter_clusters) & scoring
+		auto start = chrono::steady_clock::now();
+		fill(key_predicted.begin(), key_predicted.end(), 0);
+		int trees = 0;
+		for (int k=0; k<candidates.size(); k++) {
+			int size = candidate_spans[k].size();
+			if ((size < params.cluster_size_low_threshold) || (size > params.cluster_size_high_threshold)) {continue;}
+			if (any_of(prefilters.begin(), prefilters.end(), [&](ClusterFilter& f) {return f.rejects(cloud, candidate_spans[k], shapes[k], cylinders[k], params);})) {continue;}
+			if (cylinders[k].r > params.tree_radius_thresh) {continue;}
+			if (enclosed[k] >= (size*params.cluster_enclosing_threshold)) {continue;}
+			trees++;
+			for (int i=0; i<size; i++) {key_predicted[point_key[candidate_spans[k][i]]] = 1;}
+		}
+		for (int i=0; i<truth.size(); i++) {
+			predicted[i] = (truth_key[i] >= 0) && key_predicted[truth_key[i]];
+		}
+		MapScore score;
+		score_predictions(truth, predicted, score);
+		results[c].accuracy = score.accuracy();
+		results[c].trees = trees;
+		results[c].cluster_seconds = cluster_seconds;
+		results[c].cylinder_seconds = cylinder_seconds;
+		results[c].filter_seconds = seconds_since(start);
+	}
+}
+
+int main(int argc, char** argv) {
+	vector<string> maps = {"2_ac", "2_ad", "2_ae", "2_ag", "2_ah", "2_ai", "2_aj", "2_ak", "2_al", "2_ao", "3_aj", "3_ak", "3_al", "3_am", "3_an", "3_ao", "3_ap"};
+	string conf_dir = "confidence_files", csv_path;
+	SegmenterParams base;
+	base.rng_seed = 1;
+	vector<GridAxis> axes;
+	for (int i=1; i<argc; i++) {
+		string opt = argv[i];
+		size_t eq = opt.find('=');
+		if ((opt == "--maps") && (i+1 < argc)) {
+			maps.clear();
+			stringstream list(argv[++i]);
+			string m;
+			while (getline(list, m, ',')) {maps.push_back(m);}
+		} else if ((opt == "--seed") && (i+1 < argc)) {
+			base.rng_seed = stoll(argv[++i]);
+			if ((base.rng_seed < 0) || (base.rng_seed > UINT32_MAX)) {
+				cout << "Seed must be in 0 to " << UINT32_MAX << endl;
+				exit(1);
+			}
+		} else if ((opt == "--threads") && (i+1 < argc)) {
+			base.num_threads = stoi(argv[++i]);
+		} else if ((opt == "--conf-dir") && (i+1 < argc)) {
+			conf_dir = argv[++i];
+		} else if ((opt == "--csv") && (i+1 < argc)) {
+			csv_path = argv[++i];
+		} else if (!opt.empty() && (opt[0] != '-') && (eq != string::npos)) {
+			GridAxis axis;
+			axis.param = NULL;
+			for (int p=0; p<sweep_params.size(); p++) {
+				if (sweep_params[p].name == opt.substr(0, eq)) {axis.param = &sweep_params[p];}
+			}
+			if (axis.param == NULL) {
+				cout << "Unknown parameter: " << opt.substr(0, eq) << endl;
+				exit(1);
+			}
+			stringstream list(opt.substr(eq+1));
+			string v;
+			while (getline(list, v, ',')) {
+				axis.values.push_back(stod(v));
+				axis.texts.push_back(v);
+			}
+			if (axis.values.empty()) {
+				cout << "No values given for " << axis.param->name << endl;
+				exit(1);
+			}
+			axes.push_back(axis);
+		} else {
+			cout << "Usage: ./treeseg_sweep [name=v1,v2,...]... [--maps 2_ac,3_ap,...] [--seed S] [--threads N] [--conf-dir D] [--csv file]" << endl;
+			exit(1);
+		}
+	}
+	stable_sort(axes.begin(), axes.end(), [](const GridAxis& a, const GridAxis& b) {return a.param->level < b.param->level;});
+	vector<Combination> combos;
+	build_combinations(axes, base, combos);
+	cout << combos.size() << " combinations, " << combos.back().cluster_group+1 << " clusterings & " << combos.back().cylinder_group+1 << " sets of median cylinders per map" << endl;
+
+	auto sweep_start = chrono::steady_clock::now();
+	vector<vector<ComboResult>> results(maps.size(), vector<ComboResult>(combos.size())); // [map][combination]
+	for (int m=0; m<maps.size(); m++) {
+		GroundTruth truth;
+		string error;
+		if (!read_ground_truth(conf_dir+"/oakland_part"+maps[m]+"_conf.txt", truth, error)) {
+			cout << "Error: " << error << endl;
+			exit(1);
+		}
+		auto start = chrono::steady_clock::now();
+		sweep_map(truth, combos, results[m]);
+		cout << "map " << maps[m] << ": " << truth.size() << " points, swept in " << fixed << setprecision(2) << seconds_since(start) << " s" << endl;
+	}
+	double sweep_seconds = seconds_since(sweep_start);
+
+	// table: a row per combination
+	cout << endl;
+	for (int a=0; a<axes.size(); a++) {cout << axes[a].param->name << "  ";}
+	cout << "accuracy  trees  time(s)" << endl;
+	double separate_seconds = 0;
+	int best = 0;
+	vector<double> mean_accuracy(combos.size(), 0);
+	for (int c=0; c<combos.size(); c++) {
+		int trees = 0;
+		double seconds = 0;
+		for (int m=0; m<maps.size(); m++) {
+			ComboResult& r = results[m][c];
+			mean_accuracy[c] += r.accuracy/maps.size();
+			trees += r.trees;
+			seconds += r.cluster_seconds+r.cylinder_seconds+r.filter_seconds;
+		}
+		separate_seconds += seconds;
+		if (mean_accuracy[c] > mean_accuracy[best]) {best = c;}
+		for (int a=0; a<axes.size(); a++) {cout << setw(axes[a].param->name.size()) << axes[a].texts[combos[c].value_idx[a]] << "  ";}
+		cout << setw(8) << fixed << setprecision(2) << mean_accuracy[c] << setw(7) << trees << setw(9) << seconds << endl;
+	}
+	cout << endl << "Best mean accuracy: " << mean_accuracy[best] << " (";
+	for (int a=0; a<axes.size(); a++) {cout << (a ? ", " : "") << axes[a].param->name << "=" << axes[a].texts[combos[best].value_idx[a]];}
+	cout << ")" << endl;
+	cout << "Sweep took " << sweep_seconds << " s (running every combination separately would take " << separate_seconds << " s)" << endl;
+
+	if (!csv_path.empty()) {
+		ofstream csv(csv_path);
+		csv << "map";
+		for (int a=0; a<axes.size(); a++) {csv << ',' << axes[a].param->name;}
+		csv << ",accuracy,trees,cluster_seconds,cylinder_seconds,filter_seconds" << endl;
+		for (int c=0; c<combos.size(); c++) {
+			for (int m=0; m<maps.size(); m++) {
+				ComboResult& r = results[m][c];
+				csv << maps[m];
+				for (int a=0; a<axes.size(); a++) {csv << ',' << axes[a].texts[combos[c].value_idx[a]];}
+				csv << ',' << r.accuracy << ',' << r.trees << ',' << r.cluster_seconds << ',' << r.cylinder_seconds << ',' << r.filter_seconds << endl;
+			}
+		}
+	}
+	return 0;
+}